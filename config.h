@@ -57,9 +57,13 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes (8, or 16 for 64-bit builds) 
  */
+#if defined(__LP64__) || defined(_LP64)
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8
+#endif
 
 /* 
  * Maximum heap size in bytes 
@@ -29,9 +29,15 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define HEAP_SAMPLES  10 /* heap size samples per trace printed by -H */
+
+/* The realloc chain of -R grows one block from CHAIN_START to CHAIN_END */
+#define CHAIN_START  (1 << 20)
+#define CHAIN_STEP   (1 << 20)
+#define CHAIN_END    (100 << 20)
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
@@ -44,11 +50,16 @@ typedef struct range_t {
     struct range_t *next;  /* next list element */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/* 
+ * Characterizes a single trace operation (allocator request). A batch
+ * request allocates or frees the count blocks index to index+count-1.
+ */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC, BATCH_ALLOC, BATCH_FREE, ALIGNED_ALLOC, CALLOC} type; /* type of request */
     int index;                        /* index for free() to use later */
     int size;                         /* byte size of alloc/realloc request */
+    int count;                        /* blocks of a batch, elements of a calloc */
+    int align;                        /* alignment of an aligned alloc request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -81,6 +92,14 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    size_t heap[HEAP_SAMPLES]; /* heap and mapped bytes at evenly spaced ops */
+    size_t peak;     /* most heap and mapped bytes at once */
+    size_t sbrks;    /* calls to mem_sbrk and mem_trim */
+    mm_fit_t fits;   /* free block searches */
+    mm_stats_t counts; /* operation counters and free blocks at the end */
+    double reallocs; /* number of realloc requests */
+    double moves;    /* reallocs that returned a different block */
+    double copied;   /* payload bytes those moves had to copy */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
@@ -90,6 +109,7 @@ typedef struct {
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int free_sized = 0; /* if set, free with mm_free_sized (-S) */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -122,11 +142,18 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   stats_t *stats);
 static void eval_mm_speed(void *ptr);
+static void eval_realloc_chain(void *ptr);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printheap(int n, stats_t *stats);
+static void printcopies(int n, stats_t *stats);
+static void printfits(int n, stats_t *stats);
+static void printcounts(int n, stats_t *stats);
+static void set_option(char *arg);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -151,6 +178,8 @@ int main(int argc, char **argv)
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
     int use_mmap = 0;    /* If set, have memlib use mmap() instead malloc() */
+    int heap_trace = 0;  /* If set, print the heap size over time (-H) */
+    int realloc_chain = 0; /* If set, time a chain of large reallocs (-R) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -159,7 +188,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "nf:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "nf:t:o:hvVgalHRS")) != EOF) {
         switch (c) {
         case 'n':
             use_mmap = 1;
@@ -194,6 +223,18 @@ int main(int argc, char **argv)
         case 'V': /* Be more verbose than -v */
             verbose = 2;
             break;
+        case 'H': /* Print the heap size over time */
+            heap_trace = 1;
+            break;
+        case 'R': /* Time a chain of large reallocs */
+            realloc_chain = 1;
+            break;
+        case 'S': /* Free blocks with mm_free_sized */
+            free_sized = 1;
+            break;
+        case 'o': /* Set an mm_ctl option */
+            set_option(optarg);
+            break;
         case 'h': /* Print this message */
 	    usage();
             exit(0);
@@ -301,7 +342,7 @@ int main(int argc, char **argv)
 	if (mm_stats[i].valid) {
 	    if (verbose > 1)
 		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+	    mm_stats[i].util = eval_mm_util(trace, i, &ranges, &mm_stats[i]);
 	    speed_params.trace = trace;
 	    speed_params.ranges = ranges;
 	    if (verbose > 1)
@@ -316,6 +357,24 @@ int main(int argc, char **argv)
 	printf("\nResults for mm malloc:\n");
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
+	printcopies(num_tracefiles, mm_stats);
+	printfits(num_tracefiles, mm_stats);
+	printcounts(num_tracefiles, mm_stats);
+    }
+
+    /* Show how the heap grew and shrank during each trace */
+    if (heap_trace) {
+	printf("\nHeap size over time for mm malloc:\n");
+	printheap(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Time one block grown by many large reallocs */
+    if (realloc_chain) {
+	secs = fsecs(eval_realloc_chain, NULL);
+	printf("Realloc chain from %dMB to %dMB in %dMB steps: %.3f ms, %.1f us per realloc\n\n",
+	       CHAIN_START >> 20, CHAIN_END >> 20, CHAIN_STEP >> 20, secs * 1e3,
+	       secs * 1e6 / ((CHAIN_END - CHAIN_START) / CHAIN_STEP));
     }
 
     /* 
@@ -399,9 +458,10 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap or of a mapping */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_is_mapped(lo, hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
@@ -439,12 +499,10 @@ static void remove_range(range_t **ranges, char *lo)
 {
     range_t *p;
     range_t **prevpp = ranges;
-    int size;
 
     for (p = *ranges;  p != NULL; p = p->next) {
         if (p->lo == lo) {
 	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
             free(p);
             break;
         }
@@ -481,7 +539,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index, size, count, align;
     unsigned max_index = 0;
     unsigned op_index;
 
@@ -531,6 +589,22 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    trace->ops[op_index].size = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
+	case 'm':
+	    fscanf(tracefile, "%u %u %u", &index, &align, &size);
+	    trace->ops[op_index].type = ALIGNED_ALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].align = align;
+	    trace->ops[op_index].size = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'c':
+	    fscanf(tracefile, "%u %u %u", &index, &count, &size);
+	    trace->ops[op_index].type = CALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    trace->ops[op_index].size = count * size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
 	case 'r':
 	    fscanf(tracefile, "%u %u", &index, &size);
 	    trace->ops[op_index].type = REALLOC;
@@ -543,6 +617,21 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    trace->ops[op_index].type = FREE;
 	    trace->ops[op_index].index = index;
 	    break;
+	case 'A':
+	    fscanf(tracefile, "%u %u %u", &index, &count, &size);
+	    trace->ops[op_index].type = BATCH_ALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    trace->ops[op_index].size = size;
+	    index += count - 1;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'F':
+	    fscanf(tracefile, "%u %u", &index, &count);
+	    trace->ops[op_index].type = BATCH_FREE;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    break;
 	default:
 	    printf("Bogus type character (%c) in tracefile %s\n", 
 		   type[0], path);
@@ -583,6 +672,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     int i, j;
     int index;
     int size;
+    int count;
     int oldsize;
     char *newp;
     char *oldp;
@@ -606,12 +696,33 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
-
-	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+        case ALIGNED_ALLOC: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
+
+	    /* Call the student's malloc, memalign or calloc */
+	    if (trace->ops[i].type == ALLOC)
+		p = mm_malloc(size);
+	    else if (trace->ops[i].type == ALIGNED_ALLOC)
+		p = mm_memalign(trace->ops[i].align, size);
+	    else
+		p = mm_calloc(trace->ops[i].count, size / trace->ops[i].count);
+	    if (p == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
+	    if (trace->ops[i].type == ALIGNED_ALLOC && 
+		((size_t)p % trace->ops[i].align) != 0) {
+		malloc_error(tracenum, i, "mm_memalign returned a misaligned block.");
+		return 0;
+	    }
+	    if (trace->ops[i].type == CALLOC) {
+		for (j = 0; j < size; j++) {
+		    if (p[j] != 0) {
+			malloc_error(tracenum, i, "mm_calloc returned a block that is not zero.");
+			return 0;
+		    }
+		}
+	    }
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
@@ -657,7 +768,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -675,7 +786,38 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    if (free_sized)
+		mm_free_sized(p, trace->block_sizes[index]);
+	    else
+		mm_free(p);
+	    break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+
+	    /* Call the student's batch malloc */
+	    count = trace->ops[i].count;
+	    if (mm_malloc_batch(size, count, (void **)&trace->blocks[index]) != count) {
+		malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		return 0;
+	    }
+
+	    /* Check and fill each block as if it came from mm_malloc */
+	    for (j = index; j < index + count; j++) {
+		p = trace->blocks[j];
+		if (add_range(ranges, p, size, tracenum, i) == 0)
+		    return 0;
+		memset(p, j & 0xFF, size);
+		trace->block_sizes[j] = size;
+	    }
+	    break;
+
+        case BATCH_FREE: /* mm_free_batch */
+
+	    /* Remove the regions, then let the batch free sort and free them */
+	    count = trace->ops[i].count;
+	    for (j = index; j < index + count; j++)
+		remove_range(ranges, trace->blocks[j]);
+	    mm_free_batch((void **)&trace->blocks[index], count);
 	    break;
 
 	default:
@@ -693,16 +835,22 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+ *   most memory the heap and the mem_map() mappings held at once while 
+ *   running the student's malloc package on the trace. The brk pointer
+ *   can move down, so the final heap size is not always the high water 
+ *   mark; memlib keeps track of that.
+ *
+ *   The heap size is also sampled at HEAP_SAMPLES evenly spaced points
+ *   of the trace into stats->heap[], the last one after the final 
+ *   request, and the high water mark goes in stats->peak. A realloc that
+ *   returns a new block must have copied the smaller of the old and new
+ *   payload; those bytes are counted in stats->copied.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   stats_t *stats)
 {   
-    int i;
-    int index;
+    int i, j, k = 0;
+    int index, count;
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
@@ -718,10 +866,18 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case ALIGNED_ALLOC: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if (trace->ops[i].type == ALLOC)
+		p = mm_malloc(size);
+	    else if (trace->ops[i].type == ALIGNED_ALLOC)
+		p = mm_memalign(trace->ops[i].align, size);
+	    else
+		p = mm_calloc(trace->ops[i].count, size / trace->ops[i].count);
+	    if (p == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -746,6 +902,13 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
+	    /* Count the bytes a move had to copy */
+	    stats->reallocs++;
+	    if (newp != oldp) {
+		stats->moves++;
+		stats->copied += (newsize < oldsize) ? newsize : oldsize;
+	    }
+
 	    /* Remember region and size */
 	    trace->blocks[index] = newp;
 	    trace->block_sizes[index] = newsize;
@@ -764,7 +927,10 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    if (free_sized)
+		mm_free_sized(p, size);
+	    else
+		mm_free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -772,23 +938,84 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+        case BATCH_ALLOC: /* mm_malloc_batch */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    count = trace->ops[i].count;
+
+	    if (mm_malloc_batch(size, count, (void **)&trace->blocks[index]) != count)
+		app_error("mm_malloc_batch failed in eval_mm_util");
+	    for (j = index; j < index + count; j++)
+		trace->block_sizes[j] = size;
+
+	    total_size += size * count;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case BATCH_FREE: /* mm_free_batch */
+	    index = trace->ops[i].index;
+	    count = trace->ops[i].count;
+
+	    /* The sizes are counted first since the batch free reorders blocks */
+	    for (j = index; j < index + count; j++)
+		total_size -= trace->block_sizes[j];
+	    mm_free_batch((void **)&trace->blocks[index], count);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+
+	/* Sample the heap size after every num_ops/HEAP_SAMPLES requests */
+	while (k < HEAP_SAMPLES && 
+	       (i + 1) * HEAP_SAMPLES >= (k + 1) * trace->num_ops)
+	    stats->heap[k++] = mem_heapsize() + mem_mapsize();
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    stats->peak = mem_footprint();
+    stats->sbrks = mem_sbrk_count();
+    mm_fit_stats(&stats->fits);
+    mm_stats(&stats->counts);
+    return ((double)max_total_size / (double)mem_footprint());
 }
 
 
+/*
+ * eval_realloc_chain - This function is timed by fcyc() for -R. It grows
+ *    one block from CHAIN_START to CHAIN_END bytes, CHAIN_STEP bytes per
+ *    realloc, and writes to the new end of the block after each one.
+ */
+static void eval_realloc_chain(void *ptr)
+{
+    size_t size;
+    char *p;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in eval_realloc_chain");
+
+    if ((p = mm_malloc(CHAIN_START)) == NULL)
+	app_error("mm_malloc failed in eval_realloc_chain");
+    p[0] = 1;
+    for (size = CHAIN_START + CHAIN_STEP; size <= CHAIN_END; size += CHAIN_STEP) {
+	if ((p = mm_realloc(p, size)) == NULL)
+	    app_error("mm_realloc failed in eval_realloc_chain");
+	p[size - 1] = 1;
+    }
+    if (p[0] != 1)
+	app_error("mm_realloc lost the payload in eval_realloc_chain");
+    mm_free(p);
+}
+
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, j, index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -807,6 +1034,8 @@ static void eval_mm_speed(void *ptr)
             if ((p = mm_malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
+	    if (free_sized)
+		trace->block_sizes[index] = size;
             break;
 
 	case REALLOC: /* mm_realloc */
@@ -816,12 +1045,52 @@ static void eval_mm_speed(void *ptr)
             if ((newp = mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
+	    if (free_sized)
+		trace->block_sizes[index] = newsize;
             break;
 
         case FREE: /* mm_free */
             index = trace->ops[i].index;
             block = trace->blocks[index];
-            mm_free(block);
+	    if (free_sized)
+		mm_free_sized(block, trace->block_sizes[index]);
+	    else
+		mm_free(block);
+            break;
+
+        case ALIGNED_ALLOC: /* mm_memalign */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+		app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+	    if (free_sized)
+		trace->block_sizes[index] = size;
+            break;
+
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm_calloc(trace->ops[i].count, size / trace->ops[i].count)) == NULL)
+		app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+	    if (free_sized)
+		trace->block_sizes[index] = size;
+            break;
+
+        case BATCH_ALLOC: /* mm_malloc_batch */
+            index = trace->ops[i].index;
+            if (mm_malloc_batch(trace->ops[i].size, trace->ops[i].count,
+				(void **)&trace->blocks[index]) != trace->ops[i].count)
+		app_error("mm_malloc_batch error in eval_mm_speed");
+	    if (free_sized)
+		for (j = index; j < index + trace->ops[i].count; j++)
+		    trace->block_sizes[j] = trace->ops[i].size;
+            break;
+
+        case BATCH_FREE: /* mm_free_batch */
+            index = trace->ops[i].index;
+            mm_free_batch((void **)&trace->blocks[index], trace->ops[i].count);
             break;
 
 	default:
@@ -837,7 +1106,7 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-    int i, newsize;
+    int i, j, newsize;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -865,6 +1134,37 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
+        case ALIGNED_ALLOC: /* posix_memalign */
+	    if (posix_memalign((void **)&p, trace->ops[i].align, trace->ops[i].size) != 0) {
+		malloc_error(tracenum, i, "libc posix_memalign failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    if ((p = calloc(trace->ops[i].count, trace->ops[i].size / trace->ops[i].count)) == NULL) {
+		malloc_error(tracenum, i, "libc calloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case BATCH_ALLOC: /* malloc, one block at a time */
+	    for (j = 0; j < trace->ops[i].count; j++) {
+		if ((p = malloc(trace->ops[i].size)) == NULL) {
+		    malloc_error(tracenum, i, "libc malloc failed");
+		    unix_error("System message");
+		}
+		trace->blocks[trace->ops[i].index + j] = p;
+	    }
+	    break;
+
+        case BATCH_FREE: /* free, one block at a time */
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[trace->ops[i].index + j]);
+	    break;
+
 	default:
 	    app_error("invalid operation type  in eval_libc_valid");
 	}
@@ -880,7 +1180,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
+    int i, j;
     int index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
@@ -910,6 +1210,33 @@ static void eval_libc_speed(void *ptr)
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+        case ALIGNED_ALLOC: /* posix_memalign */
+	    index = trace->ops[i].index;
+	    if (posix_memalign((void **)&p, trace->ops[i].align, trace->ops[i].size) != 0)
+		unix_error("posix_memalign failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    index = trace->ops[i].index;
+	    if ((p = calloc(trace->ops[i].count, trace->ops[i].size / trace->ops[i].count)) == NULL)
+		unix_error("calloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case BATCH_ALLOC: /* malloc, one block at a time */
+	    index = trace->ops[i].index;
+	    for (j = 0; j < trace->ops[i].count; j++)
+		if ((trace->blocks[index + j] = malloc(trace->ops[i].size)) == NULL)
+		    unix_error("malloc failed in eval_libc_speed");
+	    break;
+
+        case BATCH_FREE: /* free, one block at a time */
+	    index = trace->ops[i].index;
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[index + j]);
+	    break;
 	}
     }
 }
@@ -919,6 +1246,126 @@ static void eval_libc_speed(void *ptr)
  ************************************/
 
 
+/*
+ * printheap - prints the sampled heap sizes of each trace in KB, the
+ *    peak from which utilization is computed, and how often the heap 
+ *    was moved
+ */
+static void printheap(int n, stats_t *stats)
+{
+    int i, k;
+
+    printf("%5s%*s%8s%7s\n", "trace", 7 * HEAP_SAMPLES, "heap KB over time", 
+	   "peak", "sbrks");
+    for (i=0; i < n; i++) {
+	printf("%2d   ", i);
+	if (stats[i].valid) {
+	    for (k = 0; k < HEAP_SAMPLES; k++)
+		printf("%7lu", (unsigned long)(stats[i].heap[k] / 1024));
+	    printf("%8lu%7lu\n", (unsigned long)(stats[i].peak / 1024),
+		   (unsigned long)stats[i].sbrks);
+	}
+	else
+	    printf("%*s\n", 7 * HEAP_SAMPLES, "-");
+    }
+}
+
+/*
+ * printcopies - prints how often realloc moved blocks, and how many bytes
+ *    that copied, for the traces that call realloc
+ */
+static void printcopies(int n, stats_t *stats)
+{
+    int i;
+    double moves = 0;
+    double copied = 0;
+    double reallocs = 0;
+
+    for (i=0; i < n; i++)
+	reallocs += stats[i].reallocs;
+    if (reallocs == 0)
+	return;
+
+    printf("Realloc copies for mm malloc:\n");
+    printf("%5s%10s%8s%12s\n", "trace", "reallocs", "moves", "KB copied");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid && stats[i].reallocs > 0) {
+	    printf("%2d%13.0f%8.0f%12.0f\n", 
+		   i,
+		   stats[i].reallocs,
+		   stats[i].moves,
+		   stats[i].copied / 1024);
+	    moves += stats[i].moves;
+	    copied += stats[i].copied;
+	}
+    }
+    printf("%12s%11.0f%12.0f\n\n", "Total       ", moves, copied / 1024);
+}
+
+/*
+ * printfits - prints the cost of the free block searches of each trace, 
+ *    in blocks looked at per search, and the quality of the fits, in bytes
+ *    the blocks found were larger than asked for
+ */
+static void printfits(int n, stats_t *stats)
+{
+    int i;
+    double searches = 0;
+    double examined = 0;
+    double slack = 0;
+
+    printf("Free block searches for mm malloc, %s fit:\n", stats[0].fits.policy);
+    printf("%5s%10s%10s%8s%12s\n", "trace", "searches", "examined", "misses", "slack/fit");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    mm_fit_t *f = &stats[i].fits;
+	    printf("%2d%13lu%10.2f%8lu%12.0f\n", 
+		   i,
+		   f->searches,
+		   f->examined / (f->searches ? (double)f->searches : 1.0),
+		   f->misses,
+		   f->slack / ((f->searches > f->misses) ? (double)(f->searches - f->misses) : 1.0));
+	    searches += f->searches;
+	    examined += f->examined;
+	    slack += f->slack / ((f->searches > f->misses) ? (double)(f->searches - f->misses) : 1.0);
+	}
+    }
+    printf("%5s%10.0f%10.2f%8s%12.0f\n\n", "Total", searches, 
+	   examined / (searches ? searches : 1.0), "", slack / n);
+}
+
+/*
+ * printcounts - prints what mm malloc did in each trace, and the free 
+ *    blocks left at the end of it. With -V the free blocks are broken 
+ *    down by list, named after the least block size each one holds.
+ */
+static void printcounts(int n, stats_t *stats)
+{
+    int i, j;
+
+    printf("Operations of mm malloc, and free blocks at the end:\n");
+    printf("%5s%10s%10s%10s%10s%10s%8s%8s%10s%10s\n", "trace", "mallocs", 
+	   "frees", "reallocs", "splits", "merges", "extends", "free", 
+	   "Kbytes", "largest");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    mm_stats_t *c = &stats[i].counts;
+	    printf("%2d%13lu%10lu%10lu%10lu%10lu%8lu%8lu%10.0f%10lu\n", 
+		   i, c->mallocs, c->frees, c->reallocs, c->splits, 
+		   c->coalesces, c->extends, c->numFree, c->free / 1024.0,
+		   (unsigned long)c->largest);
+	    for (j = 0; verbose > 1 && j < c->nbins; j++) {
+		if (c->bins[j].count > 0)
+		    printf("%15s%8lu%s%8lu%10.0f\n", "list", 
+			   (unsigned long)c->bins[j].size, 
+			   (j == c->nbins - 1) ? "+" : " ",
+			   c->bins[j].count, c->bins[j].bytes / 1024.0);
+	    }
+	}
+    }
+    printf("\n");
+}
+
 /*
  * printresults - prints a performance summary for some malloc package
  */
@@ -1003,18 +1450,55 @@ void malloc_error(int tracenum, int opnum, char *msg)
     printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
+/*
+ * set_option - set the mm_ctl option opt.name from a name=value argument.
+ *    The policy is a name, the search cap an int and the rest are sizes.
+ */
+static void set_option(char *arg)
+{
+    char name[MAXLINE];
+    char *value = strchr(arg, '=');
+    const char *policy;
+    size_t size;
+    int cap, err;
+
+    if (value == NULL)
+	app_error("-o takes <name>=<value>");
+    *value++ = '\0';
+    snprintf(name, sizeof(name), "opt.%s", arg);
+
+    if (strcmp(arg, "policy") == 0) {
+	policy = value;
+	err = mm_ctl(name, NULL, NULL, &policy, sizeof(policy));
+    } else if (strcmp(arg, "search_cap") == 0) {
+	cap = atoi(value);
+	err = mm_ctl(name, NULL, NULL, &cap, sizeof(cap));
+    } else {
+	size = strtoul(value, NULL, 0);
+	err = mm_ctl(name, NULL, NULL, &size, sizeof(size));
+    }
+    if (err != 0) {
+	snprintf(msg, sizeof(msg), "-o %s=%s: %s", arg, value, strerror(err));
+	app_error(msg);
+    }
+}
+
 /* 
  * usage - Explain the command line arguments
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValHRS] [-f <file>] [-t <dir>] [-o <name>=<value>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Print the heap size over time and the sbrk calls.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-o <n>=<v> Set mm_ctl option opt.<n> to <v>.\n");
+    fprintf(stderr, "\t-R         Time a chain of large reallocs.\n");
+    fprintf(stderr, "\t-S         Free blocks with mm_free_sized.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
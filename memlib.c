@@ -3,6 +3,7 @@
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE          /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -18,9 +19,25 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_fresh;      /* heap bytes from here up have never been used, so read as zero */
 static int use_mmap;         /* Use mmap instead of malloc */
 static void * mmap_addr = (void *)0x58000000;
 
+/* anonymous mappings handed out by mem_map, apart from the heap */
+#define MAX_MAPS 4096
+static struct {
+    char *start;
+    size_t size;
+} maps[MAX_MAPS];
+static int num_maps;         /* number of mappings in maps */
+static size_t mem_mapped;    /* bytes mapped right now */
+static size_t mem_peak;      /* most bytes in the heap and mappings at once */
+static size_t mem_sbrks;     /* calls to mem_sbrk and mem_trim since the last mem_reset_brk */
+
+static void update_peak(void);
+static void release_pages(char *lo, char *hi);
+static void unmap_all(void);
+
 /* 
  * mem_init - initialize the memory system model
  */
@@ -44,7 +61,7 @@ void mem_init(int _use_mmap)
             exit(1);
         }
     } else {
-        if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
+        if ((mem_start_brk = (char *)calloc(1, MAX_HEAP)) == NULL) {
             fprintf(stderr, "mem_init_vm: malloc error\n");
             exit(1);
         }
@@ -52,6 +69,7 @@ void mem_init(int _use_mmap)
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_fresh = mem_start_brk;                /* and all of it is zero */
 }
 
 /* 
@@ -59,6 +77,7 @@ void mem_init(int _use_mmap)
  */
 void mem_deinit(void)
 {
+    unmap_all();
     if (use_mmap) {
         if (munmap(mem_start_brk, MAX_HEAP))
             perror("munmap");
@@ -68,31 +87,240 @@ void mem_deinit(void)
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap,
+ *    and drop all mappings
  */
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    unmap_all();
+    mem_peak = 0;
+    mem_sbrks = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
  *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    this model, the heap cannot be shrunk by mem_sbrk; mem_trim does 
+ *    that. Memory outside the heap comes from mem_map. The new area is
+ *    zero from mem_heap_fresh() on.
  */
 void *mem_sbrk(int incr) 
 {
     char *old_brk = mem_brk;
 
+    mem_sbrks++;
     if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return NULL;
     }
     mem_brk += incr;
+    if (mem_brk > mem_fresh)
+	mem_fresh = mem_brk;
+    update_peak();
     return (void *)old_brk;
 }
 
+/*
+ * mem_trim - shrink the heap by decr bytes. The whole pages above the 
+ *    new brk are given back to the system. Returns 0 on success, -1 if 
+ *    the heap is smaller than decr bytes.
+ */
+int mem_trim(size_t decr)
+{
+    char *old_brk = mem_brk;
+
+    mem_sbrks++;
+    if (decr > mem_heapsize()) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_trim failed. Heap cannot shrink that far...\n");
+	return -1;
+    }
+    mem_brk -= decr;
+    release_pages(mem_brk, old_brk);
+    return 0;
+}
+
+/*
+ * mem_map - map size bytes of fresh anonymous memory outside the heap,
+ *    rounded up to whole pages. Returns NULL if that fails.
+ */
+void *mem_map(size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    char *start;
+
+    size = (size + pagesize - 1) & ~(pagesize - 1);
+    if (num_maps == MAX_MAPS) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    start = mmap(NULL, size, PROT_READ|PROT_WRITE, 
+		 MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (start == MAP_FAILED)
+	return NULL;
+
+    maps[num_maps].start = start;
+    maps[num_maps].size = size;
+    num_maps++;
+    mem_mapped += size;
+    update_peak();
+    return (void *)start;
+}
+
+/*
+ * mem_unmap - give a mapping back to the system. [addr, addr+size) must 
+ *    be a whole mapping from mem_map or the tail of one, which shrinks it. 
+ *    Returns 0 on success, -1 otherwise.
+ */
+int mem_unmap(void *addr, size_t size)
+{
+    char *p = (char *)addr;
+    int i;
+
+    for (i = 0; i < num_maps; i++) {
+	if (p >= maps[i].start && p + size == maps[i].start + maps[i].size)
+	    break;
+    }
+    if (i == num_maps || munmap(p, size) != 0)
+	return -1;
+
+    mem_mapped -= size;
+    maps[i].size -= size;
+    if (maps[i].size == 0)
+	maps[i] = maps[--num_maps];
+    return 0;
+}
+
+/*
+ * mem_remap - resize the mapping at addr from old_size to size bytes, 
+ *    rounded up to whole pages. The pages are moved, not copied, if the
+ *    mapping cannot grow where it is. Returns the new start, or NULL if 
+ *    addr is not a mapping or the system is out of memory.
+ */
+void *mem_remap(void *addr, size_t old_size, size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    char *start;
+    int i;
+
+    size = (size + pagesize - 1) & ~(pagesize - 1);
+    for (i = 0; i < num_maps; i++) {
+	if (maps[i].start == (char *)addr && maps[i].size == old_size)
+	    break;
+    }
+    if (i == num_maps)
+	return NULL;
+
+    start = mremap(addr, old_size, size, MREMAP_MAYMOVE);
+    if (start == MAP_FAILED)
+	return NULL;
+
+    maps[i].start = start;
+    maps[i].size = size;
+    mem_mapped = mem_mapped - old_size + size;
+    update_peak();
+    return (void *)start;
+}
+
+/*
+ * mem_is_mapped - true if the bytes lo..hi lie in one mapping
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    int i;
+
+    for (i = 0; i < num_maps; i++) {
+	if ((char *)lo >= maps[i].start && 
+	    (char *)hi < maps[i].start + maps[i].size)
+	    return 1;
+    }
+    return 0;
+}
+
+/*
+ * mem_mapsize - returns the number of bytes mapped by mem_map
+ */
+size_t mem_mapsize()
+{
+    return mem_mapped;
+}
+
+/*
+ * mem_footprint - returns the most bytes the heap and the mappings 
+ *    together have held since the last mem_reset_brk. The heap can 
+ *    shrink, so this is not always mem_heapsize() + mem_mapsize().
+ */
+size_t mem_footprint()
+{
+    return mem_peak;
+}
+
+/*
+ * mem_sbrk_count - returns the number of mem_sbrk and mem_trim calls 
+ *    since the last mem_reset_brk
+ */
+size_t mem_sbrk_count()
+{
+    return mem_sbrks;
+}
+
+/*
+ * update_peak - remember the current footprint if it is a new high
+ */
+static void update_peak(void)
+{
+    size_t now = mem_heapsize() + mem_mapped;
+
+    if (now > mem_peak)
+	mem_peak = now;
+}
+
+/*
+ * release_pages - drop the contents of the whole pages between lo and 
+ *    hi, so that the system can reuse them. They read as zero again, so
+ *    if nothing above hi was ever used the fresh part of the heap starts
+ *    at the first of them.
+ */
+static void release_pages(char *lo, char *hi)
+{
+    size_t pagesize = mem_pagesize();
+    char *start = (char *)(((size_t)lo + pagesize - 1) & ~(pagesize - 1));
+    char *end = (char *)((size_t)hi & ~(pagesize - 1));
+
+    if (start < end) {
+	if (madvise(start, end - start, MADV_DONTNEED) != 0)
+	    perror("madvise");
+	else if (mem_fresh == hi) {
+	    memset(end, 0, hi - end);
+	    mem_fresh = start;
+	}
+    }
+}
+
+/*
+ * unmap_all - give every mapping back to the system
+ */
+static void unmap_all(void)
+{
+    while (num_maps > 0) {
+	num_maps--;
+	munmap(maps[num_maps].start, maps[num_maps].size);
+    }
+    mem_mapped = 0;
+}
+
+/*
+ * mem_heap_fresh - return the address from which the heap above the brk
+ *    has never been used. Bytes from there up read as zero when mem_sbrk
+ *    hands them out.
+ */
+void *mem_heap_fresh()
+{
+    return (void *)mem_fresh;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
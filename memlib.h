@@ -3,9 +3,18 @@
 void mem_init(int use_mmap);               
 void mem_deinit(void);
 void *mem_sbrk(int incr);
+int mem_trim(size_t decr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_heap_fresh(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+void *mem_map(size_t size);
+int mem_unmap(void *addr, size_t size);
+void *mem_remap(void *addr, size_t old_size, size_t size);
+int mem_is_mapped(void *lo, void *hi);
+size_t mem_mapsize(void);
+size_t mem_footprint(void);
+size_t mem_sbrk_count(void);
 
@@ -3,22 +3,100 @@
  *
  * Our explicit free list implementation uses the head and 
  * footers to store pointers to the next and previous free blocks.
+ *
+ * Only free blocks have a footer. Every header carries a second bit that
+ * tells whether the block in front of it is allocated, so the previous 
+ * block's footer is read only when that block is free.
  * 
  * The free list is split into segregated lists to improve performance.
  *
- * Each segregated list will store free blocks in order from smallest to 
- * largest. In this way we search for the best fit to improve memory utility.
- * 
- * global variables minList and numFree are added to speed up searches.
+ * The segregated lists are indexed in two levels, as in TLSF. The first
+ * level splits sizes into power of two classes and the second level splits
+ * each class linearly into SL_INDEX_COUNT sub classes. A bitmap for each
+ * level records which lists are non-empty, so a fit is found with a couple
+ * of find-first-set instructions instead of walking the lists.
+ *
+ * Free blocks of LARGE_BLOCK_SIZE bytes and more are kept out of the lists
+ * in an AVL tree ordered by size and address, with the tree links stored 
+ * in the free block. Large requests take the exact best fit from the tree.
+ * No free block is ever inserted by walking a list: a block goes on the 
+ * front of its list, and the tree keeps the large ones sorted in O(log n).
+ *
+ * All of this state belongs to an arena: its index lives in the prologue 
+ * block of the arena's first heap segment, and the arena keeps the number 
+ * of its free blocks to speed up searches. A normal build has one arena.
+ *
+ * Built with MM_THREADS the allocator is thread-safe. Each thread is bound 
+ * to one of MM_ARENAS arenas, each with its own lock. Arenas take the heap
+ * in ARENA_CHUNK pieces, and a map from chunks to arenas sends a free or 
+ * realloc back to the arena that owns the block. A thread freeing a block
+ * of another arena pushes it on that arena's lock-free remote queue, which
+ * is emptied by the next thread to lock the arena. An arena whose segments
+ * are not contiguous keeps them apart with fence blocks.
+ *
+ * Requests of at most SLAB_MAX bytes do not get boundary tags. They are 
+ * served from slabs, SLAB_SIZE aligned allocated blocks that are cut into
+ * equal slots of one size class. A slab keeps its own free slot list, and
+ * a bitmap over the heap marks which SLAB_SIZE pages are slabs so that
+ * mm_free can tell slab pointers from boundary tag blocks.
+ *
+ * Blocks from just above SLAB_MAX up to FAST_MAX bytes are not coalesced
+ * when they are freed. They stay allocated on a LIFO fast bin of their 
+ * size, and a malloc of that size takes them back as they are. The fast 
+ * bins are coalesced all at once when a search of the lists fails or when
+ * they hold more than FAST_LIMIT bytes.
+ *
+ * The heap grows by the arena's growth step, or by what a request needs if
+ * that is more. The step doubles, up to growMax, while the heap has to grow
+ * again and again, and halves for every GROW_BURST fits found without 
+ * growing it. A free block at the end of the heap counts towards a request,
+ * so only the shortfall is added.
+ *
+ * When a free block of trimThreshold bytes or more ends the heap, the break
+ * is moved down and the memory goes back to the system.
+ *
+ * Memory that mem_sbrk hands out for the first time is zero. Each arena 
+ * remembers from where on the free block at its end was never written, 
+ * so that mm_calloc only clears the bytes of a block that were used 
+ * before.
+ *
+ * Requests of mmapThreshold bytes and more skip the heap. Each gets a 
+ * mapping of its own, marked MAPPED in its header, that is unmapped as 
+ * soon as the block is freed and grown by remapping its pages.
+ *
+ * Built with MM_CHECK every CHECK_EVERY th operation ends by checking a few
+ * blocks of the heap, a few entries of the free lists and one path down 
+ * the tree, going on where the last check stopped, and every CHECK_FULL 
+ * operations mm_check goes over all of it. A broken heap is reported and
+ * the program aborted.
+ *
+ * In front of all of this every thread has a small cache of the blocks it 
+ * freed last, one bin per block size. The cached blocks stay allocated, so
+ * a malloc served from the cache takes no lock and writes no header. A bin
+ * that is full goes back to the arenas half at a time. Cached blocks do 
+ * not coalesce, which costs some utilization, so the cache is built only 
+ * with TCACHE, which MM_THREADS builds turn on.
+ *
+ * mm_ctl reads and sets the tunables above by name while the program 
+ * runs, reads the mm_stats counters, and purges arenas.
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -40,41 +118,167 @@ team_t team = {
 
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
 
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
-static char *heap_listp = NULL;
-int minList = 0;             // keeps track of the list number for the free list containing the first free block  
-int numFree = 0;             // Keeps track of the number of free blocks            
+/* An arena: its own segregated lists in its own part of the heap */
+typedef struct {
+    char *index;             // prologue payload holding the bitmaps and list heads, NULL until used
+    char *top;               // epilogue of the arena's last heap segment
+    int numFree;             // Keeps track of the number of free blocks            
+    size_t fastBytes;        // bytes waiting in the fast bins
+    char *fresh;             // bytes from here to the footer of the last free block are zero
+    size_t growStep;         // least number of bytes the heap grows by next
+    unsigned int growQuiet;  // fits found since the heap last grew
+    char *rover;             // free block the next next fit search starts at
+    unsigned long fitSearches;   // free block searches
+    unsigned long fitExamined;   // free blocks they looked at
+    unsigned long fitMisses;     // searches that found nothing
+    double fitSlack;             // bytes the blocks found were larger than asked for
+    unsigned long mallocs;   // blocks allocated from the arena
+    unsigned long frees;     // blocks freed to it
+    unsigned long reallocs;  // reallocs that it resized in place or next door
+    unsigned long splits;    // free blocks split in two
+    unsigned long coalesces; // blocks merged with a free neighbor
+    unsigned long extends;   // times it grew the heap
+#ifdef MM_CHECK
+    char *checkBlock;        // heap block the checker looks at next, NULL for the first
+    char *checkEntry;        // list entry it looks at next, NULL for the head of checkList
+    int checkList;           // list it is going through
+    unsigned long checkOps;  // operations checked since mm_init
+#endif
+#ifdef MM_THREADS
+    pthread_mutex_t lock;
+    char *volatile remote;   // blocks freed by threads of other arenas, pushed without the lock
+    int remoteCount;         // number of blocks on the remote queue
+#endif
+} arena_t;
+
+#ifdef MM_THREADS
+ #ifndef NO_TCACHE
+ #define TCACHE
+ #endif
+ #ifndef MM_ARENAS
+ #define MM_ARENAS 16
+ #endif
+ #define THREAD_LOCAL __thread
+ #define LOCK(m) pthread_mutex_lock(m)
+ #define TRYLOCK(m) pthread_mutex_trylock(m)
+ #define UNLOCK(m) pthread_mutex_unlock(m)
+#else
+ #undef MM_ARENAS
+ #define MM_ARENAS 1
+ #define THREAD_LOCAL
+ #define LOCK(m)
+ #define UNLOCK(m)
+#endif
+
+static arena_t arenas[MM_ARENAS];
+static THREAD_LOCAL arena_t *arena;   // arena the calling thread is working on, locked
+static unsigned int heapEpoch = 0;    // bumped by mm_init, which drops every thread cache
+
+static arena_t *thread_arena(void);
+static arena_t *arena_of(void *bp);
+static void arena_lock(arena_t *a);
+static void arena_unlock(void);
+static int arena_init(void);
+static void *heap_grow(size_t *size, char **fresh);
+static void heap_trim(void *bp);
+static void heap_release(void *bp, size_t keep);
+static size_t grow_step(size_t need);
+static void *mapped_alloc(size_t size);
+static void mapped_free(void *bp);
+static void *mapped_realloc(void *bp, size_t size);
+#ifdef MM_THREADS
+static void remote_free(arena_t *a, void *bp);
+static void remote_drain(void);
+#endif
 static void *extend_heap(size_t words);
+static void *malloc_block(size_t size);
+static void *fit_block(size_t adjSize);
+static void *calloc_block(size_t size);
+static void clear_bytes(char *p, size_t n);
+static void free_block(void *bp);
+static void *realloc_block(void *ptr, size_t size);
+static void grow_track(void *bp, size_t size, int grows);
 static void *coalesce(void *bp);
 static void add_free_list(void *bp);
 static void remove_free_list(void *bp);
 static void *find_fit(size_t adjSize);
+static void *good_fit(size_t size);
+static void *first_fit(size_t size);
+static void *next_fit(size_t size);
+static void *best_fit(size_t size);
+static void *list_from(int fl, int sl);
+static void *walk_list(char *bp, char *stop, size_t size, int cap, int best);
+static void stats_tree(char *node, mm_stats_t *stats);
+static void arena_purge(arena_t *a);
+static void ctl_lock_all(int lock);
+static void mapping_insert(size_t size, int *fl, int *sl);
+static char *tree_insert(char *root, char *bp);
+static char *tree_remove(char *root, char *bp);
+static char *tree_best_fit(size_t size);
 static void place(void *bp, size_t adjSize);
-//static int mm_check(void);
+static void split_block(void *bp, size_t total, size_t adjSize);
+static void *alloc_aligned(size_t align, size_t adjSize);
+static void *slab_alloc(int cls);
+static void slab_free(void *bp);
+static void release_block(void *bp);
+static void fast_put(void *bp, size_t size);
+static void *fast_get(size_t size);
+static int fast_consolidate(void);
+#ifdef TCACHE
+static void *tcache_get(int bin);
+static int tcache_put(void *bp, size_t size);
+static void tcache_flush(int bin, int keep);
+#endif
+#ifdef MM_CHECK
+static int mm_check(void);
+static void check_slice(void);
+static void check_carve(char *bp, size_t size);
+#endif
 
 /////////// Macros from the book /////////////////
 
-/* Basic constants and macros */
+/* 
+ * Basic constants and macros. A word holds a pointer, so words are 8 bytes
+ * and blocks 16 byte aligned in 64-bit builds.
+ */
+typedef size_t word_t;
+#if defined(__LP64__) || defined(_LP64)
+ #define WSIZE 8 /* Word and header/footer size (bytes) */
+#else
  #define WSIZE 4 /* Word and header/footer size (bytes) */
- #define DSIZE 8 /* Double word size (bytes) */
+#endif
+ #define DSIZE (2*WSIZE) /* Double word size (bytes) */
  #define CHUNKSIZE (1<<12) /* Extend heap by this amount (bytes) */
 
  #define MAX(x, y) ((x) > (y)? (x) : (y))
+ #define MIN(x, y) ((x) < (y)? (x) : (y))
 
  /* Pack a size and allocated bit into a word */
  #define PACK(size, alloc) ((size) | (alloc))
 
+/* Header bit set when the previous block is allocated */
+ #define PREV_ALLOC 0x2
+
+/* Header bit of a block with a mapping of its own */
+ #define MAPPED 0x4
+
  /* Read and write a word at address p */
- #define GET(p) (*(unsigned int *)(p))
- #define PUT(p, val) (*(unsigned int *)(p) = (val))
+ #define GET(p) (*(word_t *)(p))
+ #define PUT(p, val) (*(word_t *)(p) = (val))
 
  /* Read the size and allocated fields from address p */
  #define GET_SIZE(p) (GET(p) & ~0x7)
  #define GET_ALLOC(p) (GET(p) & 0x1)
+ #define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+
+/* Set or clear the previous allocated bit in the header of block bp */
+ #define SET_PREV_ALLOC(bp) (PUT(HDRP(bp), GET(HDRP(bp)) | PREV_ALLOC))
+ #define CLEAR_PREV_ALLOC(bp) (PUT(HDRP(bp), GET(HDRP(bp)) & ~PREV_ALLOC))
 
  /* Given block ptr bp, compute address of its header and footer */
  #define HDRP(bp) ((char *)(bp) - WSIZE)
@@ -84,59 +288,545 @@ static void place(void *bp, size_t adjSize);
  #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
  #define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/* Block size for a request: payload plus header, aligned, at least a free block */
+ #define ADJ_SIZE(size) (MAX(2*DSIZE, DSIZE * (((size) + WSIZE + (DSIZE-1)) / DSIZE)))
+
+/////////// Two level segregated list index /////////////////
+
+/* 
+ * The shape of the index, the search cap and the placement policy below 
+ * can be set at compile time; the Makefile builds a driver for each 
+ * combination of policy and lists per class.
+ */
+
+/* Each power of two class is split into SL_INDEX_COUNT lists, at most 32 */
+#ifndef SL_INDEX_COUNT_LOG2
+ #define SL_INDEX_COUNT_LOG2 4
+#endif
+ #define SL_INDEX_COUNT (1 << SL_INDEX_COUNT_LOG2)
+
+/* Blocks below SMALL_BLOCK_SIZE share first level 0, one list per DSIZE */
+ #define ALIGN_SIZE_LOG2 (WSIZE == 8 ? 4 : 3)
+ #define FL_INDEX_SHIFT (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2)
+ #define SMALL_BLOCK_SIZE (1 << FL_INDEX_SHIFT)
+
+/* Blocks on the lists are smaller than 2^FL_INDEX_MAX bytes, larger ones go in the tree */
+#ifndef FL_INDEX_MAX
+ #define FL_INDEX_MAX 12
+#endif
+ #define FL_INDEX_COUNT (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+ #define LARGE_BLOCK_SIZE (1 << FL_INDEX_MAX)
+
+/* Words of the prologue payload used by the index, kept even for alignment */
+ #define INDEX_WORDS ((1 + FL_INDEX_COUNT + FL_INDEX_COUNT*SL_INDEX_COUNT + SLAB_CLASSES + 1 + FAST_BINS + 1) & ~0x1)
+
+/* Address of the first level bitmap, a second level bitmap and a list head */
+ #define FL_BITMAP (arena->index)
+ #define SL_BITMAP(fl) (arena->index + ((1 + (fl)) * WSIZE))
+ #define LIST_HEAD(fl, sl) (arena->index + ((1 + FL_INDEX_COUNT + (fl)*SL_INDEX_COUNT + (sl)) * WSIZE))
+
+/* Address of the list of slabs with free slots for a size class */
+ #define SLAB_HEAD(cls) (arena->index + ((1 + FL_INDEX_COUNT + FL_INDEX_COUNT*SL_INDEX_COUNT + (cls)) * WSIZE))
+
+/* Address of the root of the large block tree */
+ #define TREE_ROOT (arena->index + ((1 + FL_INDEX_COUNT + FL_INDEX_COUNT*SL_INDEX_COUNT + SLAB_CLASSES) * WSIZE))
+
+/* Address of the fast bin of a block size */
+ #define FAST_HEAD(bin) (TREE_ROOT + ((1 + (bin)) * WSIZE))
+
+/* A tree node keeps its left and right child and the height of its subtree */
+ #define LEFT(bp) ((char *)(bp))
+ #define RIGHT(bp) ((char *)(bp) + WSIZE)
+ #define HEIGHT(bp) ((char *)(bp) + (2*WSIZE))
+ #define GET_LEFT(bp) ((char *)GET(LEFT(bp)))
+ #define GET_RIGHT(bp) ((char *)GET(RIGHT(bp)))
+
+/* Tree order: by size, then by address */
+ #define TREE_LESS(a, b) (GET_SIZE(HDRP(a)) < GET_SIZE(HDRP(b)) || \
+                          (GET_SIZE(HDRP(a)) == GET_SIZE(HDRP(b)) && (char *)(a) < (char *)(b)))
+
+/* Index of the lowest and highest set bit of a non-zero word */
+ #define FFS(x) (__builtin_ctzl(x))
+ #define FLS(x) (8*(int)sizeof(long) - 1 - __builtin_clzl(x))
+
+/* Blocks looked at on a list when the bitmap search finds nothing */
+#ifndef FIT_SEARCH_CAP
+ #define FIT_SEARCH_CAP 16
+#endif
+static int fitSearchCap = FIT_SEARCH_CAP;   // negative for no cap
+
+/* 
+ * Placement policy of find_fit, MM_FIT_GOOD unless MM_POLICY names another.
+ * Built with FIT_POLICY it is a constant, and find_fit has no switch left.
+ */
+#ifdef FIT_POLICY
+ #define fitPolicy FIT_POLICY
+#else
+static int fitPolicy = MM_FIT_GOOD;
+#endif
+
+/* MM_CHECK builds check a slice of the heap every CHECK_EVERY operations, a power of two */
+#ifndef CHECK_EVERY
+ #define CHECK_EVERY 64
+#endif
+
+/* The bytes from bp on are made into new blocks, so the checker must not stop inside them */
+#ifdef MM_CHECK
+ #define CHECK_CARVE(bp, size) check_carve((char *)(bp), (size))
+#else
+ #define CHECK_CARVE(bp, size)
+#endif
+static const char *fitPolicies[] = {"good", "first", "next", "best"};
+
+/////////// Small object slabs /////////////////
+
+/* Requests up to SLAB_MAX bytes use slabs, one size class per DSIZE */
+ #define SLAB_MAX 64
+ #define SLAB_CLASSES (SLAB_MAX / DSIZE)
+ #define SLAB_CLASS(size) (((size) - 1) / DSIZE)
+ #define SLAB_SLOT(cls) (((cls) + 1) * DSIZE)
+
+/* Slabs are SLAB_SIZE bytes and aligned to SLAB_SIZE */
+ #define SLAB_SHIFT 10
+ #define SLAB_SIZE (1 << SLAB_SHIFT)
+ #define SLAB_PAGE(bp) ((char *)((word_t)(bp) & ~(word_t)(SLAB_SIZE-1)))
+
 /* 
- * mm_init initializes the initial heap area. It also creates 84 words for the 
- * segregated lists. 
+ * The first words of a slab: the next and previous slab of its class with
+ * free slots, the free slot list, the first never used slot, the number of
+ * slots in use and the size class. The slots start after them.
+ */
+ #define SLAB_NEXT(s) ((char *)(s))
+ #define SLAB_PREV(s) ((char *)(s) + WSIZE)
+ #define SLAB_FREE(s) ((char *)(s) + (2*WSIZE))
+ #define SLAB_BUMP(s) ((char *)(s) + (3*WSIZE))
+ #define SLAB_USED(s) ((char *)(s) + (4*WSIZE))
+ #define SLAB_CLS(s) ((char *)(s) + (5*WSIZE))
+ #define SLAB_FIRST(s) ((char *)(s) + (6*WSIZE))
+ #define SLAB_SLOTS(cls) ((SLAB_SIZE - 6*WSIZE) / SLAB_SLOT(cls))
+
+/* One bit per SLAB_SIZE page of the heap, set when the page is a slab */
+ #define SLAB_MAP_WORDS ((MAX_HEAP >> SLAB_SHIFT) / 32 + 2)
+static unsigned int slabMap[SLAB_MAP_WORDS];
+static char *slabBase = NULL;   // SLAB_SIZE aligned address the bitmap starts at
+
+ #define SLAB_INDEX(bp) ((word_t)(SLAB_PAGE(bp) - slabBase) >> SLAB_SHIFT)
+ #define IS_SLAB(bp) (SLAB_INDEX(bp) < SLAB_MAP_WORDS*32 && \
+                      (slabMap[SLAB_INDEX(bp) / 32] >> (SLAB_INDEX(bp) % 32)) & 1)
+
+/* Arenas share bitmap words, so with threads the bits are set atomically */
+#ifdef MM_THREADS
+ #define SLAB_MARK(s) __sync_fetch_and_or(&slabMap[SLAB_INDEX(s) / 32], 1U << (SLAB_INDEX(s) % 32))
+ #define SLAB_UNMARK(s) __sync_fetch_and_and(&slabMap[SLAB_INDEX(s) / 32], ~(1U << (SLAB_INDEX(s) % 32)))
+#else
+ #define SLAB_MARK(s) (slabMap[SLAB_INDEX(s) / 32] |= 1U << (SLAB_INDEX(s) % 32))
+ #define SLAB_UNMARK(s) (slabMap[SLAB_INDEX(s) / 32] &= ~(1U << (SLAB_INDEX(s) % 32)))
+#endif
+
+/////////// Fast bins /////////////////
+
+/* Freed blocks of FAST_MIN to FAST_MAX bytes wait in a bin per block size */
+ #define FAST_MIN ADJ_SIZE(SLAB_MAX + 1)
+ #define FAST_MAX 512
+ #define FAST_BINS ((FAST_MAX - FAST_MIN) / DSIZE + 1)
+ #define FAST_BIN(size) (((size) - FAST_MIN) / DSIZE)
+
+/* The bins are coalesced once they hold more than FAST_LIMIT bytes */
+ #define FAST_LIMIT (1 << 15)
+
+/////////// Arenas /////////////////
+
+/* Arenas take the heap in pieces of ARENA_CHUNK bytes */
+ #define ARENA_CHUNK (1 << 16)
+ #define CHUNK_MAP_SIZE (MAX_HEAP / ARENA_CHUNK + 1)
+
+static char *heapBase = NULL;                    // first heap byte, where the chunks start
+static size_t chunkSize = CHUNKSIZE;             // least bytes an arena starts with and grows by
+static unsigned long mapMallocs, mapFrees, mapReallocs;   // mapped blocks allocated, freed and resized
+
+#ifdef MM_THREADS
+static unsigned char chunkMap[CHUNK_MAP_SIZE];   // arena number of every chunk of the heap
+static unsigned int nextArena = 0;               // arena the next new thread is bound to
+static pthread_mutex_t memLock = PTHREAD_MUTEX_INITIALIZER;   // serializes calls into memlib
+#endif
+
+/* 
+ * mm_init initializes the initial heap area. All arenas start out unused 
+ * and the first one is set up right away.
  *
  * return -1 if the allocation fails, 0 otherwise
  */
 int mm_init(void)
 {
+    int i;
+
+#ifndef FIT_POLICY
+    // the placement policy can be picked without rebuilding, or by mm_ctl
+    char *policy = getenv("MM_POLICY");
+    for(i = 0; policy != NULL && i < (int)(sizeof(fitPolicies) / sizeof(fitPolicies[0])); i++) {
+        if (strcmp(policy, fitPolicies[i]) == 0){
+            fitPolicy = i;
+        }
+    }
+#endif
+
+    // start with no slabs, no arenas and empty thread caches
+    heapEpoch++;
+    slabBase = SLAB_PAGE(mem_heap_lo());
+    memset(slabMap, 0, sizeof(slabMap));
+    heapBase = mem_heap_lo();
+#ifdef MM_THREADS
+    memset(chunkMap, 0, sizeof(chunkMap));
+#endif
+    for(i = 0; i < MM_ARENAS; i++) {
+        arenas[i].index = NULL;
+        arenas[i].top = NULL;
+        arenas[i].numFree = 0;
+        arenas[i].fastBytes = 0;
+        arenas[i].fresh = NULL;
+        arenas[i].growStep = chunkSize;
+        arenas[i].growQuiet = 0;
+        arenas[i].rover = NULL;
+        arenas[i].fitSearches = 0;
+        arenas[i].fitExamined = 0;
+        arenas[i].fitMisses = 0;
+        arenas[i].fitSlack = 0;
+        arenas[i].mallocs = 0;
+        arenas[i].frees = 0;
+        arenas[i].reallocs = 0;
+        arenas[i].splits = 0;
+        arenas[i].coalesces = 0;
+        arenas[i].extends = 0;
+#ifdef MM_CHECK
+        arenas[i].checkBlock = NULL;
+        arenas[i].checkEntry = NULL;
+        arenas[i].checkList = 0;
+        arenas[i].checkOps = 0;
+#endif
+#ifdef MM_THREADS
+        pthread_mutex_init(&arenas[i].lock, NULL);
+        arenas[i].remote = NULL;
+        arenas[i].remoteCount = 0;
+#endif
+    }
+
+    mapMallocs = mapFrees = mapReallocs = 0;
+
+    arena = &arenas[0];
+    return arena_init();
+}
+
+/*
+ * Set up the current arena in a new heap segment. The prologue block holds
+ * the bitmaps and list heads of the segregated list index, and the rest of
+ * the segment, at least chunkSize bytes, is one free block.
+ *
+ * return -1 if the heap cannot be extended, 0 otherwise
+ */
+ static int arena_init(void)
+ {
+    size_t size = (INDEX_WORDS + 4)*WSIZE + chunkSize;
+    char *start, *fresh;
+
     // initialize heap, return -1 if failed
-    if ((heap_listp = mem_sbrk(88*WSIZE)) == (void *)-1){
+    if ((start = heap_grow(&size, &fresh)) == NULL){
         return -1;
     }
 
     // start with no free blocks
-    minList = 100; 
-    numFree = 0; 
+    arena->numFree = 0; 
+    arena->fastBytes = 0;
 
-    PUT(heap_listp, 0); 
-    PUT(heap_listp + (1*WSIZE), PACK(43*DSIZE, 1)); 
+    PUT(start, 0); 
+    PUT(start + (1*WSIZE), PACK((INDEX_WORDS + 2)*WSIZE, 1)); 
 
-    // initialize 84 segregated free lists
+    // clear the bitmaps and the list heads
     int i;
-    for(i = 2; i < 86; i++) {
-        PUT(heap_listp + (i*WSIZE), 0); 
+    for(i = 2; i < INDEX_WORDS + 2; i++) {
+        PUT(start + (i*WSIZE), 0); 
     }
 
-    // prologue header and footer
-    PUT(heap_listp + (87*WSIZE), PACK(0, 1));
-    PUT(heap_listp + (86*WSIZE), PACK(43*DSIZE, 1));
+    // prologue footer
+    PUT(start + ((INDEX_WORDS + 2)*WSIZE), PACK((INDEX_WORDS + 2)*WSIZE, 1));
 
     // start by pointing to the prologue
-    heap_listp += (2*WSIZE);  
+    arena->index = start + (2*WSIZE);  
 
-    /* Extend the empty heap with a free block with 
-    *  size CHUNKSIZE, return -1 if failed 
-    */
-    if (extend_heap(CHUNKSIZE/WSIZE) == NULL){
-        return -1;
-    }
+    // the rest of the segment is a free block followed by the epilogue
+    char *bp = start + (INDEX_WORDS + 4)*WSIZE;
+    size -= (INDEX_WORDS + 4)*WSIZE;
+    PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+    PUT(FTRP(bp), PACK(size, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+    arena->top = NEXT_BLKP(bp);
+    add_free_list(bp);
+
+    // the free block is zero past its list links
+    arena->fresh = MAX(bp + 3*WSIZE, fresh);
 
     return 0; 
-}
+ }
+
+/*
+ * Return the arena of the calling thread. A thread is bound to an arena,
+ * round robin, the first time it allocates.
+ */
+ static arena_t *thread_arena(void)
+ {
+#ifdef MM_THREADS
+    static __thread arena_t *mine = NULL;
+
+    if (mine == NULL){
+        mine = &arenas[__sync_fetch_and_add(&nextArena, 1) % MM_ARENAS];
+    }
+    return mine;
+#else
+    return &arenas[0];
+#endif
+ }
+
+/*
+ * Return the arena that owns the block or slab slot bp.
+ */
+ static arena_t *arena_of(void *bp)
+ {
+#ifdef MM_THREADS
+    return &arenas[chunkMap[((char *)bp - heapBase) / ARENA_CHUNK]];
+#else
+    (void)bp;
+    return &arenas[0];
+#endif
+ }
 
+/*
+ * Lock arena a and make it the current arena of the calling thread. Blocks
+ * waiting on its remote queue are freed first.
+ */
+ static void arena_lock(arena_t *a)
+ {
+    LOCK(&a->lock);
+    arena = a;
+#ifdef MM_THREADS
+    if (a->remote != NULL){
+        remote_drain();
+    }
+#endif
+ }
+
+/*
+ * Unlock the current arena, checking a slice of it first in MM_CHECK builds.
+ */
+ static void arena_unlock(void)
+ {
+#ifdef MM_CHECK
+    if ((++arena->checkOps & (CHECK_EVERY - 1)) == 0){
+        check_slice();
+    }
+#endif
+    UNLOCK(&arena->lock);
+ }
+
+#ifdef MM_THREADS
+/* Remote blocks a queue holds before a pusher frees them itself */
+ #define REMOTE_MAX 256
+
+/*
+ * Push bp on the remote free queue of arena a, which belongs to another 
+ * thread, without taking the arena's lock. Once REMOTE_MAX blocks are 
+ * waiting and the arena is not locked, the pusher frees them itself.
+ */
+ static void remote_free(arena_t *a, void *bp)
+ {
+    char *head;
+    arena_t *cur;
+
+    do {
+        head = a->remote;
+        PUT(bp, (word_t)head);
+    } while (!__sync_bool_compare_and_swap(&a->remote, head, (char *)bp));
+
+    if (__sync_add_and_fetch(&a->remoteCount, 1) >= REMOTE_MAX && 
+        TRYLOCK(&a->lock) == 0){
+        cur = arena;
+        arena = a;
+        remote_drain();
+        arena_unlock();
+        arena = cur;
+    }
+ }
+
+/*
+ * Free every block on the remote queue of the current arena, which is 
+ * locked. The queue is taken in one atomic swap.
+ */
+ static void remote_drain(void)
+ {
+    char *bp = __sync_lock_test_and_set(&arena->remote, NULL);
+    char *next;
+    int n = 0;
 
+    for (; bp != NULL; bp = next, n++){
+        next = (char *)GET(bp);
+        free_block(bp);
+    }
+    __sync_sub_and_fetch(&arena->remoteCount, n);
+ }
+#endif
 
 /*
- * extends the size of the heap by words words.
+ * Move the break of the heap up by *size bytes for the current arena and 
+ * return the start of the new memory. The new memory is zero from *fresh
+ * on. In MM_THREADS builds the size is rounded up to whole chunks, which
+ * are recorded as the arena's.
  *
- * Return -1 if heap cant be extended, 0 otherwise;
+ * Return NULL if the heap is full or could never hold *size bytes.
  */
- static void *extend_heap(size_t words)
+ static void *heap_grow(size_t *size, char **fresh)
  {
     char *bp;
+
+    // mem_sbrk takes an int, which a larger size would overflow
+    if (*size > MAX_HEAP){
+        return NULL;
+    }
+
+#ifdef MM_THREADS
+    LOCK(&memLock);
+    *size = (*size + (ARENA_CHUNK-1)) & ~(ARENA_CHUNK-1);
+#endif
+    *fresh = mem_heap_fresh();
+    bp = mem_sbrk(*size);
+    if (bp == NULL || bp == (void *)-1){
+        bp = NULL;
+    }
+    else{
+        *fresh = MAX(bp, *fresh);
+#ifdef MM_THREADS
+        size_t i;
+        for (i = 0; i < *size; i += ARENA_CHUNK){
+            chunkMap[(bp + i - heapBase) / ARENA_CHUNK] = arena - arenas;
+        }
+#endif
+    }
+#ifdef MM_THREADS
+    UNLOCK(&memLock);
+#endif
+    return bp;
+ }
+
+/* A free last block of trimThreshold bytes or more is cut down to about TRIM_KEEP */
+#ifndef TRIM_THRESHOLD
+ #define TRIM_THRESHOLD (1 << 17)
+#endif
+ #define TRIM_KEEP (trimThreshold / 2)
+static size_t trimThreshold = TRIM_THRESHOLD;
+
+/* The break moves down in whole units, chunks in MM_THREADS builds */
+#ifdef MM_THREADS
+ #define TRIM_UNIT ARENA_CHUNK
+#else
+ #define TRIM_UNIT CHUNKSIZE
+#endif
+
+/*
+ * If the free block bp is trimThreshold bytes or larger, release all but
+ * about TRIM_KEEP bytes of it. Works on the current arena.
+ */
+ static void heap_trim(void *bp)
+ {
+    if (GET_SIZE(HDRP(bp)) >= trimThreshold){
+        heap_release(bp, TRIM_KEEP);
+    }
+ }
+
+/*
+ * If the free block bp is the last block of the heap, move the break down
+ * so that keep bytes of it, at least, are left. Only the arena at the end
+ * of the heap can do this. Works on the current arena.
+ */
+ static void heap_release(void *bp, size_t keep)
+ {
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t release;
+
+    if (NEXT_BLKP(bp) != arena->top || size < keep){
+        return;
+    }
+    release = (size - keep) & ~(TRIM_UNIT - 1);
+    if (release == 0){
+        return;
+    }
+
+#ifdef MM_THREADS
+    LOCK(&memLock);
+#endif
+    if ((char *)mem_heap_hi() + 1 == arena->top && mem_trim(release) == 0){
+        // shrink the block and move the epilogue in front of the new break
+        remove_free_list(bp);
+        size -= release;
+        PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(size, 0));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+        arena->top = NEXT_BLKP(bp);
+        arena->fresh = MIN(arena->fresh, arena->top);
+        add_free_list(bp);
+    }
+#ifdef MM_THREADS
+    UNLOCK(&memLock);
+#endif
+ }
+
+/* The heap grows by at most growMax bytes more than a request needs */
+#ifndef GROW_MAX
+ #define GROW_MAX (1 << 16)
+#endif
+static size_t growMax = GROW_MAX;
+
+/* The growth step is at most a 2^GROW_SHIFT th of the heap */
+#ifndef GROW_SHIFT
+ #define GROW_SHIFT 4
+#endif
+
+/* The growth step halves for every GROW_BURST fits found without growing */
+#ifndef GROW_BURST
+ #define GROW_BURST 64
+#endif
+
+/*
+ * Return the number of bytes to grow the heap by when it has to grow by at
+ * least need bytes, and adapt the growth step of the current arena. Growing
+ * soon after the last time doubles the step, a quiet spell halves it once 
+ * for every GROW_BURST fits, down to chunkSize. The heap always grows by
+ * enough for a free block.
+ */
+ static size_t grow_step(size_t need)
+ {
+    unsigned int halvings = arena->growQuiet / GROW_BURST;
+
+    if (halvings == 0){
+        arena->growStep = MIN(MAX(2*arena->growStep, chunkSize), growMax);
+    }
+    else{
+        arena->growStep = MAX(arena->growStep >> MIN(halvings, 16), chunkSize);
+    }
+    arena->growStep = MIN(arena->growStep, (mem_heapsize() >> GROW_SHIFT) & ~(DSIZE-1));
+    arena->growQuiet = 0;
+
+    return MAX(MAX(need, 2*DSIZE), arena->growStep);
+ }
+
+/*
+ * extends the size of the heap by words words. If another arena grew the
+ * heap since the current arena did, the new memory starts a new segment 
+ * behind an allocated fence block so it never coalesces with a block of 
+ * the other arena.
+ *
+ * Return NULL if heap cant be extended, the new free block otherwise;
+ */
+ static void *extend_heap(size_t words)
+ {
+    char *bp, *fresh;
+    char *oldTop = arena->top;
     size_t size;
 
     // Must extend by an even number to maintain allignment
@@ -148,552 +838,2570 @@ int mm_init(void)
     }
 
     //return null if failed moving heap pointer
-    bp = mem_sbrk(size);
-    if ((long)(bp) == -1){
+    bp = heap_grow(&size, &fresh);
+    if (bp == NULL){
         return NULL;
     }
+    arena->extends++;
 
-    // set the free block header and footer
-    PUT(HDRP(bp), PACK(size, 0)); 
+    if (bp == arena->top){
+        // set the free block header, the old epilogue knows the previous block
+        PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)))); 
+    }
+    else{
+        // padding and a fence block in front of the new free block
+        PUT(bp, 0);
+        PUT(bp + WSIZE, PACK(DSIZE, 1 | PREV_ALLOC));
+        bp += 2*DSIZE;
+        size -= 2*DSIZE;
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC)); 
+    }
     PUT(FTRP(bp), PACK(size, 0)); 
 
     // set epilogue header
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+    arena->top = NEXT_BLKP(bp);
 
     // Combine consecutive free blocks
-    bp = coalesce(bp);
+    char *newBP = coalesce(bp);
 
-    return bp;
+    // a new free block is zero past its links. Merged with the old last 
+    // free block, the old footer and epilogue are all that keeps a zero 
+    // end of that block from running on into the new memory
+    if (newBP == bp){
+        arena->fresh = MAX(bp + 3*WSIZE, fresh);
+    }
+    else if (arena->fresh <= oldTop - DSIZE && fresh <= oldTop){
+        PUT(oldTop - DSIZE, 0);
+        PUT(oldTop - WSIZE, 0);
+    }
+    else{
+        arena->fresh = MAX(oldTop, fresh);
+    }
+
+    return newBP;
  }
- 
- 
-/* 
- * Search the free list for for a large enough free block. If found then place
- * it. If not found then allocate size for it. Extend the heap if necessary.
+
+/////////// Mapped blocks /////////////////
+
+/* Requests of at least mmapThreshold bytes get a mapping of their own */
+#ifndef MMAP_THRESHOLD
+ #define MMAP_THRESHOLD (1 << 17)
+#endif
+static size_t mmapThreshold = MMAP_THRESHOLD;
+
+/* Mapping length for a request: padding, header and payload in whole pages */
+ #define MAPPED_SIZE(size) (((size) + DSIZE + mem_pagesize() - 1) & ~(mem_pagesize() - 1))
+
+/* Largest request whose mapping length does not wrap around */
+ #define MAPPED_MAX ((size_t)-1 - DSIZE - mem_pagesize())
+
+ #define IS_MAPPED(bp) (GET(HDRP(bp)) & MAPPED)
+
+/* Whether bp lies in the heap, and so is not mapped, without its header */
+ #define IN_HEAP(bp) ((word_t)((char *)(bp) - heapBase) < MAX_HEAP)
+
+/*
+ * Give a block of at least size bytes a mapping of its own. The mapping
+ * starts with a padding word and the header, and the mapping length is
+ * the block size.
  *
- * Return NULL if either size == 0 or heap is full, 
- * otherwise return a pointer to the new block.
+ * Return NULL if the size is too large or the mapping fails.
  */
-void *mm_malloc(size_t size)
-{
-    // Dont waste time allocating nothing
-    if (size == 0){
+ static void *mapped_alloc(size_t size)
+ {
+    size_t len;
+    char *start;
+
+    if (size > MAPPED_MAX){
         return NULL;
     }
- 
-    // Get an adjusted size so that we conform to allignment
-    size_t adjSize; 
-    if (size <= DSIZE){
-        adjSize = 2*DSIZE;
-    }
-    else{
-        adjSize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+    len = MAPPED_SIZE(size);
+
+#ifdef MM_THREADS
+    LOCK(&memLock);
+#endif
+    start = mem_map(len);
+    mapMallocs += (start != NULL);
+#ifdef MM_THREADS
+    UNLOCK(&memLock);
+#endif
+    if (start == NULL){
+        return NULL;
     }
 
-    // search free list for a fiting block
-    char *bp = find_fit(adjSize);
-    if (bp != NULL) {
-        place(bp, adjSize);
+    PUT(start + WSIZE, PACK(len, 1 | MAPPED));
+    return start + DSIZE;
+ }
+
+/*
+ * Unmap the mapped block bp.
+ */
+ static void mapped_free(void *bp)
+ {
+#ifdef MM_THREADS
+    LOCK(&memLock);
+#endif
+    mem_unmap((char *)bp - DSIZE, GET_SIZE(HDRP(bp)));
+    mapFrees++;
+#ifdef MM_THREADS
+    UNLOCK(&memLock);
+#endif
+ }
+
+/*
+ * Resize the mapped block bp. Shrinking unmaps the pages at the end, 
+ * growing remaps the pages, so the payload is never copied.
+ *
+ * Return the resized block, or NULL if the size is too large or no memory
+ * is left. The block is left as it was then.
+ */
+ static void *mapped_realloc(void *bp, size_t size)
+ {
+    size_t len;
+    size_t oldLen = GET_SIZE(HDRP(bp));
+    char *start;
+
+    if (size > MAPPED_MAX){
+        return NULL;
+    }
+    len = MAPPED_SIZE(size);
+
+    if (len <= oldLen){
+        if (len < oldLen){
+#ifdef MM_THREADS
+            LOCK(&memLock);
+#endif
+            mem_unmap((char *)bp - DSIZE + len, oldLen - len);
+            mapReallocs++;
+#ifdef MM_THREADS
+            UNLOCK(&memLock);
+#endif
+            PUT(HDRP(bp), PACK(len, 1 | MAPPED));
+        }
         return bp;
     }
 
-    // Extend heap if necessary
-    size_t extendsize = MAX(adjSize,CHUNKSIZE);
-    bp = extend_heap(extendsize/WSIZE);
-    if (bp  == NULL){
+#ifdef MM_THREADS
+    LOCK(&memLock);
+#endif
+    start = mem_remap((char *)bp - DSIZE, oldLen, len);
+    mapReallocs += (start != NULL);
+#ifdef MM_THREADS
+    UNLOCK(&memLock);
+#endif
+    if (start == NULL){
         return NULL;
     }
-        
-    //place in new memory.  
-    place(bp, adjSize);
-    return bp;
-}
 
+    PUT(start + WSIZE, PACK(len, 1 | MAPPED));
+    return start + DSIZE;
+ }
+
+/////////// Thread cache /////////////////
+#ifdef TCACHE
 
-/* 
- * Searches the free list for a free block lareg enough for the requesting 
- * malloc call. Start at the minimum free list that is lareg enough to 
- * save time.
+/* Blocks of up to TCACHE_MAX bytes are cached, TCACHE_COUNT per bin */
+ #define TCACHE_MAX 256
+ #define TCACHE_COUNT 8
+ #define TCACHE_BINS (ADJ_SIZE(TCACHE_MAX) / DSIZE + 1)
+
+/* Bin of a request: slab slots up to SLAB_MAX, block sizes above it */
+ #define TCACHE_BIN(size) (((size) <= SLAB_MAX ? SLAB_SLOT(SLAB_CLASS(size)) \
+                                                : ADJ_SIZE(size)) / DSIZE)
+
+typedef struct {
+    char *bins[TCACHE_BINS];             // cached blocks, linked through their first word
+    unsigned char count[TCACHE_BINS];
+    unsigned int epoch;                  // heap the cached blocks belong to
+} tcache_t;
+
+static THREAD_LOCAL tcache_t tcache;
+
+#ifdef MM_THREADS
+static pthread_key_t tcacheKey;          // empties the cache when its thread exits
+static pthread_once_t tcacheOnce = PTHREAD_ONCE_INIT;
+
+ static void tcache_release(void *unused)
+ {
+    int bin;
+
+    (void)unused;
+    if (tcache.epoch == heapEpoch){
+        for (bin = 0; bin < TCACHE_BINS; bin++){
+            tcache_flush(bin, 0);
+        }
+    }
+ }
+
+ static void tcache_key_init(void)
+ {
+    pthread_key_create(&tcacheKey, tcache_release);
+ }
+#endif
+
+/*
+ * Take a block from a bin of the calling thread's cache.
+ *
+ * Return NULL if the bin is empty.
  */
- static void *find_fit(size_t size)
+ static void *tcache_get(int bin)
  {
-     
-    //no free blocks
-    if(numFree == 0){
+    char *bp = tcache.bins[bin];
+
+    if (bp == NULL || tcache.epoch != heapEpoch){
         return NULL;
     }
-         
-    // calculate where the minimum free list large enough is
-    int minListLocal = size / 50;
-      
-    if(minListLocal < minList){
-        minListLocal = minList;
-    }   
-    else if(minListLocal > 83){
-        minListLocal = 83;
-    } 
-         
-    //Loop through the remaining free lists starting at min list.  
-    for(; minListLocal < 84; minListLocal++){
-        int i = 0;
-        // look for a large enough block
-        void *bp = (char *)GET(heap_listp + (minListLocal * WSIZE));
-        for (;  i < 250 && (int)bp != 0 && GET_SIZE(HDRP(bp)) > 0; bp = (char *)GET(bp+WSIZE)) {
-            if (!GET_ALLOC(HDRP(bp)) && (size <= GET_SIZE(HDRP(bp)))) {
-                //found one
-                return bp;
-            }
-            i++;
-        }
-    }
-    //if no fits wer found return null
-    return NULL;
-}
- 
-/* 
- * places a block into a block pointer. split the block into an allocated
- * and free block if it is large enough to accomodate both. That block will then 
- * be removed from free list.
- */ 
- static void place(void *bp, size_t size)
+    tcache.bins[bin] = (char *)GET(bp);
+    tcache.count[bin]--;
+    return bp;
+ }
+
+/*
+ * Put the freed block bp into the calling thread's cache, first sending 
+ * half of its bin back to the arenas if the bin is full. The size is the
+ * slot size of a slab slot and the block size of other blocks, and may be
+ * less than the real size.
+ *
+ * Return 0 if the block is too large to be cached, 1 otherwise.
+ */
+ static int tcache_put(void *bp, size_t size)
  {
-    size_t currentSize = GET_SIZE(HDRP(bp));
-    //Large enough to hold bp AND a free block 
-    if ((currentSize - size) >= (2*DSIZE)) {
-                 
-        // remove from free list
-        remove_free_list(bp);
-                 
-        PUT(HDRP(bp), PACK(size, 1));
-        PUT(FTRP(bp), PACK(size, 1));
-                 
-        void * nextBP = NEXT_BLKP(bp);
-                 
-        PUT(HDRP(nextBP), PACK(currentSize-size, 0));
-        PUT(FTRP(nextBP), PACK(currentSize-size, 0));
-                                  
-        //ADD new free block to free list
-        add_free_list(nextBP);
+    int bin;
+
+    if (!IS_SLAB(bp) && (size <= SLAB_MAX || size >= TCACHE_BINS * DSIZE)){
+        return 0;
     }
-         
-    //not large enough for a free block to remain.
-    else {
-        //set to allocated 
-        PUT(HDRP(bp), PACK(currentSize, 1));
-        PUT(FTRP(bp), PACK(currentSize, 1));
-        //remove from free list 
-        remove_free_list(bp);
+    bin = size / DSIZE;
+
+    // a cache left from before the last mm_init starts over
+    if (tcache.epoch != heapEpoch){
+        memset(&tcache, 0, sizeof(tcache));
+        tcache.epoch = heapEpoch;
+#ifdef MM_THREADS
+        pthread_once(&tcacheOnce, tcache_key_init);
+        pthread_setspecific(tcacheKey, &tcache);
+#endif
+    }
+
+    if (tcache.count[bin] == TCACHE_COUNT){
+        tcache_flush(bin, TCACHE_COUNT / 2);
+    }
+    PUT(bp, (word_t)tcache.bins[bin]);
+    tcache.bins[bin] = bp;
+    tcache.count[bin]++;
+    return 1;
+ }
+
+/*
+ * Free all but the first keep blocks of a bin, the ones that were cached
+ * first. Blocks of the thread's own arena are freed under a single lock,
+ * the others go on their arena's remote queue.
+ */
+ static void tcache_flush(int bin, int keep)
+ {
+    char *bp, *next, *last;
+    int locked = 0;
+    int i;
+
+    if (keep == 0){
+        bp = tcache.bins[bin];
+        tcache.bins[bin] = NULL;
+    }
+    else{
+        last = tcache.bins[bin];
+        for (i = 1; i < keep; i++){
+            last = (char *)GET(last);
+        }
+        bp = (char *)GET(last);
+        PUT(last, 0);
+    }
+    tcache.count[bin] = keep;
+
+    for (; bp != NULL; bp = next){
+        next = (char *)GET(bp);
+#ifdef MM_THREADS
+        if (arena_of(bp) != thread_arena()){
+            remote_free(arena_of(bp), bp);
+            continue;
+        }
+#endif
+        if (!locked){
+            arena_lock(thread_arena());
+            locked = 1;
+        }
+        free_block(bp);
+    }
+    if (locked){
+        arena_unlock();
+    }
+ }
+#endif
+ 
+/* 
+ * Allocate a block of at least size bytes from the calling thread's arena.
+ *
+ * Return NULL if either size == 0 or heap is full, 
+ * otherwise return a pointer to the new block.
+ */
+void *mm_malloc(size_t size)
+{
+    void *bp;
+
+    // Dont waste time allocating nothing
+    if (size == 0){
+        return NULL;
+    }
+
+    // huge requests get their own mapping, or the heap if that fails
+    if (size >= mmapThreshold && (bp = mapped_alloc(size)) != NULL){
+        return bp;
+    }
+
+    // the heap could never hold it, and ADJ_SIZE would wrap near SIZE_MAX
+    if (size > MAX_HEAP){
+        return NULL;
+    }
+
+#ifdef TCACHE
+    // a cached block needs no lock
+    if (size <= TCACHE_MAX && (bp = tcache_get(TCACHE_BIN(size))) != NULL){
+        return bp;
+    }
+#endif
+
+    // the arena is set up the first time a thread uses it
+    arena_lock(thread_arena());
+    if (arena->index == NULL && arena_init() < 0){
+        bp = NULL;
+    }
+    else{
+        bp = malloc_block(size);
+    }
+    arena->mallocs += (bp != NULL);
+    arena_unlock();
+    return bp;
+}
+
+/*
+ * Allocate a block of at least size bytes whose payload address is a 
+ * multiple of alignment, a power of two. Up to ALIGNMENT every block is
+ * aligned; beyond it the block comes from the heap, never from a slab or
+ * a mapping, and the part of the free block in front of the aligned 
+ * payload is split off as a free block of its own.
+ *
+ * Return NULL if size == 0, alignment is not a power of two or the heap
+ * is full, otherwise a pointer to the new block.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    void *bp;
+
+    if (size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0){
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT){
+        return mm_malloc(size);
+    }
+    if (size > MAX_HEAP || alignment > MAX_HEAP){
+        return NULL;
+    }
+
+    arena_lock(thread_arena());
+    if (arena->index == NULL && arena_init() < 0){
+        bp = NULL;
+    }
+    else{
+        bp = alloc_aligned(alignment, ADJ_SIZE(size));
+    }
+    arena->mallocs += (bp != NULL);
+    arena_unlock();
+    return bp;
+}
+
+/*
+ * C11 aligned_alloc, the same as mm_memalign.
+ */
+void *mm_aligned_alloc(size_t alignment, size_t size)
+{
+    return mm_memalign(alignment, size);
+}
+
+/* 
+ * Search the free list for for a large enough free block. If found then place
+ * it. If not found then allocate size for it. Extend the heap if necessary.
+ * Works on the current arena.
+ *
+ * Return NULL if the heap is full, otherwise return a pointer to the new block.
+ */
+ static void *malloc_block(size_t size)
+ {
+    // small requests go to the slabs
+    if (size <= SLAB_MAX){
+        return slab_alloc(SLAB_CLASS(size));
+    }
+ 
+    // Get an adjusted size so that we conform to allignment
+    size_t adjSize = ADJ_SIZE(size); 
+    char *bp;
+
+    // a block of the same size freed before is taken back as it is
+    if (adjSize <= FAST_MAX && (bp = fast_get(adjSize)) != NULL){
+        return bp;
+    }
+
+    bp = fit_block(adjSize);
+    if (bp == NULL){
+        return NULL;
+    }
+    place(bp, adjSize);
+    return bp;
+ }
+
+/*
+ * Find a free block of at least adjSize bytes, coalescing the fast bins if
+ * none fits and extending the heap if there still is none. Works on the 
+ * current arena.
+ *
+ * Return NULL if the heap is full, otherwise the free block.
+ */
+ static void *fit_block(size_t adjSize)
+ {
+    // search free list for a fiting block, coalescing the fast bins if none fits
+    char *bp = find_fit(adjSize);
+    if (bp == NULL && fast_consolidate()){
+        bp = find_fit(adjSize);
+    }
+    if (bp != NULL) {
+        arena->growQuiet++;
+        return bp;
+    }
+
+    // a capped search can miss the free block that ends the heap, and it
+    // is taken as it is if it fits. Otherwise extend the heap, by the 
+    // shortfall if a free block ends it
+    size_t need = adjSize;
+    if (GET_PREV_ALLOC(HDRP(arena->top)) == 0){
+        bp = PREV_BLKP(arena->top);
+        if (GET_SIZE(HDRP(bp)) >= adjSize){
+            return bp;
+        }
+        need = adjSize - GET_SIZE(HDRP(bp));
+    }
+    bp = extend_heap(grow_step(need)/WSIZE);
+
+    // the new memory is a segment of its own if another arena grew the heap
+    while (bp != NULL && GET_SIZE(HDRP(bp)) < adjSize){
+        bp = extend_heap(grow_step(adjSize - GET_SIZE(HDRP(bp)))/WSIZE);
+    }
+    return bp;
+ }
+
+/* Clears of CLEAR_STREAM bytes and more bypass the cache */
+ #define CLEAR_STREAM (1 << 18)
+
+/*
+ * Allocate nmemb elements of size bytes, all zero. Bytes that the heap 
+ * never used before are not cleared again, and a new mapping is zero 
+ * already.
+ *
+ * Return NULL if either size is 0, the product overflows or the heap is
+ * full, otherwise a pointer to the new block.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+    void *bp;
+
+    if (nmemb == 0 || size == 0 || nmemb > (size_t)-1 / size){
+        return NULL;
+    }
+    size *= nmemb;
+
+    if (size >= mmapThreshold && (bp = mapped_alloc(size)) != NULL){
+        return bp;
+    }
+
+    // the heap could never hold it, and ADJ_SIZE would wrap near SIZE_MAX
+    if (size > MAX_HEAP){
+        return NULL;
+    }
+
+    arena_lock(thread_arena());
+    if (arena->index == NULL && arena_init() < 0){
+        bp = NULL;
+    }
+    else{
+        bp = calloc_block(size);
+    }
+    arena->mallocs += (bp != NULL);
+    arena_unlock();
+    return bp;
+}
+
+/*
+ * Allocate a zeroed block of size bytes in the current arena. Small blocks
+ * are recycled memory and cleared in full. A larger block is cleared up to
+ * where the free block it came from was fresh, and where the footer of 
+ * the last free block was if it reaches that far.
+ *
+ * Return NULL if the heap is full, otherwise a pointer to the new block.
+ */
+ static void *calloc_block(size_t size)
+ {
+    size_t adjSize = ADJ_SIZE(size);
+    char *bp, *fresh, *top, *end, *cut;
+
+    if (size <= SLAB_MAX || adjSize <= FAST_MAX){
+        bp = malloc_block(size);
+        if (bp != NULL){
+            memset(bp, 0, size);
+        }
+        return bp;
+    }
+
+    bp = fit_block(adjSize);
+    if (bp == NULL){
+        return NULL;
+    }
+    fresh = arena->fresh;
+    top = arena->top;
+    place(bp, adjSize);
+
+    end = bp + size;
+    cut = MIN(end, MAX(fresh, bp));
+    clear_bytes(bp, cut - bp);
+    if (cut < end && end > top - DSIZE){
+        cut = MAX(cut, top - DSIZE);
+        clear_bytes(cut, end - cut);
+    }
+    return bp;
+ }
+
+/*
+ * Clear n bytes at p. Clears of CLEAR_STREAM bytes and more use non-temporal
+ * stores, which do not pull the cleared lines into the cache.
+ */
+ static void clear_bytes(char *p, size_t n)
+ {
+#ifdef __SSE2__
+    if (n >= CLEAR_STREAM){
+        __m128i zero = _mm_setzero_si128();
+        size_t head = (16 - ((word_t)p & 15)) & 15;
+
+        memset(p, 0, head);
+        p += head;
+        n -= head;
+        for (; n >= 64; p += 64, n -= 64){
+            _mm_stream_si128((__m128i *)p, zero);
+            _mm_stream_si128((__m128i *)(p + 16), zero);
+            _mm_stream_si128((__m128i *)(p + 32), zero);
+            _mm_stream_si128((__m128i *)(p + 48), zero);
+        }
+        _mm_sfence();
+    }
+#endif
+    memset(p, 0, n);
+ }
+
+
+/* 
+ * Searches the free lists for a free block of at least size bytes with the
+ * placement policy, and counts the search. Large requests take the best 
+ * fit from the tree whatever the policy, as do small ones that no list can
+ * serve.
+ */
+ static void *find_fit(size_t size)
+ {
+    void *bp;
+
+    arena->fitSearches++;
+
+    //no free blocks
+    if(arena->numFree == 0){
+        bp = NULL;
+    }
+
+    // large requests take the best fit from the tree
+    else if(size >= LARGE_BLOCK_SIZE){
+        bp = tree_best_fit(size);
+    }
+    else{
+        switch(fitPolicy){
+        case MM_FIT_FIRST:
+            bp = first_fit(size);
+            break;
+        case MM_FIT_NEXT:
+            bp = next_fit(size);
+            break;
+        case MM_FIT_BEST:
+            bp = best_fit(size);
+            break;
+        default:
+            bp = good_fit(size);
+            break;
+        }
+    }
+
+    if(bp == NULL){
+        arena->fitMisses++;
+    }
+    else{
+        arena->fitSlack += GET_SIZE(HDRP(bp)) - size;
+    }
+    return bp;
+ }
+
+/*
+ * Good fit: the size is rounded up to the next list boundary so that any 
+ * block on the selected list fits, and the bitmaps give the first non-empty
+ * list at or above it. The block at the head of that list is returned. 
+ * Only if there is none is the list the size maps to searched, for no more
+ * than fitSearchCap blocks.
+ */
+ static void *good_fit(size_t size)
+ {
+    int fl, sl;
+
+    // round up so that every block on the list is large enough
+    size_t roundSize = size;
+    if(size >= SMALL_BLOCK_SIZE){
+        roundSize += (1 << (FLS(size) - SL_INDEX_COUNT_LOG2)) - 1;
+    }
+    mapping_insert(roundSize, &fl, &sl);
+
+    void *bp = list_from(fl, sl);
+    if(bp != NULL){
+        arena->fitExamined++;
+        return bp;
+    }
+
+    // the list the size itself maps to may still hold a large enough block
+    mapping_insert(size, &fl, &sl);
+    bp = walk_list((char *)GET(LIST_HEAD(fl, sl)), NULL, size, fitSearchCap, 0);
+    if(bp != NULL){
+        return bp;
+    }
+
+    // otherwise every block in the tree is large enough
+    return tree_best_fit(size);
+ }
+
+/*
+ * First fit: the whole list the size maps to is searched from its head, 
+ * and failing that the head of the next non-empty list is taken.
+ */
+ static void *first_fit(size_t size)
+ {
+    int fl, sl;
+
+    mapping_insert(size, &fl, &sl);
+    void *bp = walk_list((char *)GET(LIST_HEAD(fl, sl)), NULL, size, -1, 0);
+    if(bp == NULL && (bp = list_from(fl, sl + 1)) != NULL){
+        arena->fitExamined++;
+    }
+    return bp != NULL ? bp : tree_best_fit(size);
+ }
+
+/*
+ * Next fit: like first fit, but a search of the list the size maps to 
+ * starts where the last one stopped, at the rover, and wraps around to the
+ * head of the list. The rover moves on to the block after the one found.
+ */
+ static void *next_fit(size_t size)
+ {
+    int fl, sl, rfl, rsl;
+    char *head, *bp = NULL;
+
+    mapping_insert(size, &fl, &sl);
+    head = (char *)GET(LIST_HEAD(fl, sl));
+
+    // the rover only counts if it is on this list
+    char *rover = arena->rover;
+    if(rover != NULL){
+        mapping_insert(GET_SIZE(HDRP(rover)), &rfl, &rsl);
+        if(rfl != fl || rsl != sl){
+            rover = NULL;
+        }
+    }
+
+    if(rover != NULL){
+        bp = walk_list(rover, NULL, size, -1, 0);
+        if(bp == NULL){
+            bp = walk_list(head, rover, size, -1, 0);
+        }
+    }
+    else{
+        bp = walk_list(head, NULL, size, -1, 0);
+    }
+
+    if(bp != NULL){
+        arena->rover = (char *)GET((char *)bp + WSIZE);
+        return bp;
+    }
+    if((bp = list_from(fl, sl + 1)) != NULL){
+        arena->fitExamined++;
+        return bp;
+    }
+    return tree_best_fit(size);
+ }
+
+/*
+ * Best fit: the smallest large enough block of the first list that has 
+ * one, which searches that whole list.
+ */
+ static void *best_fit(size_t size)
+ {
+    int fl, sl;
+
+    mapping_insert(size, &fl, &sl);
+    void *bp = walk_list((char *)GET(LIST_HEAD(fl, sl)), NULL, size, -1, 1);
+    if(bp == NULL && (bp = list_from(fl, sl + 1)) != NULL){
+        // every block on a larger list fits
+        bp = walk_list(bp, NULL, 0, -1, 1);
+    }
+    return bp != NULL ? bp : tree_best_fit(size);
+ }
+
+/*
+ * Return the head of the first non-empty list at or above list sl of 
+ * class fl, using the bitmaps, or NULL if all of them are empty.
+ */
+ static void *list_from(int fl, int sl)
+ {
+    unsigned int slMap, flMap;
+
+    if(sl >= SL_INDEX_COUNT){
+        fl++;
+        sl = 0;
+    }
+    if(fl >= FL_INDEX_COUNT){
+        return NULL;
+    }
+
+    // look for a non-empty list in the same power of two class
+    slMap = GET(SL_BITMAP(fl)) & (~0U << sl);
+    if(slMap == 0){
+        // otherwise use the first non-empty larger class
+        flMap = GET(FL_BITMAP) & (~0U << (fl + 1));
+        if(flMap == 0){
+            return NULL;
+        }
+        fl = FFS(flMap);
+        slMap = GET(SL_BITMAP(fl));
+    }
+    return (char *)GET(LIST_HEAD(fl, FFS(slMap)));
+ }
+
+/*
+ * Walk a list from bp up to, but not including, stop, looking at no more
+ * than cap blocks, or all of them if cap is negative. Return the first 
+ * block of at least size bytes, or the smallest one if best is set, or 
+ * NULL if there is none.
+ */
+ static void *walk_list(char *bp, char *stop, size_t size, int cap, int best)
+ {
+    char *found = NULL;
+
+    for (; bp != stop && (word_t)bp != 0 && cap != 0; bp = (char *)GET(bp+WSIZE), cap--) {
+        size_t bsize = GET_SIZE(HDRP(bp));
+
+        arena->fitExamined++;
+        if (size <= bsize && (found == NULL || bsize < GET_SIZE(HDRP(found)))) {
+            found = bp;
+            if (!best || bsize == size) {
+                break;
+            }
+        }
+    }
+    return found;
+ }
+
+/*
+ * Return the smallest block in the tree of at least size bytes, the one at
+ * the lowest address if there are several, or NULL if there is none.
+ */
+ static char *tree_best_fit(size_t size)
+ {
+    char *node = (char *)GET(TREE_ROOT);
+    char *best = NULL;
+
+    while ((word_t)node != 0){
+        arena->fitExamined++;
+        if (GET_SIZE(HDRP(node)) >= size){
+            best = node;
+            node = GET_LEFT(node);
+        }
+        else{
+            node = GET_RIGHT(node);
+        }
+    }
+    return best;
+ }
+
+/*
+ * Height of the subtree at node, 0 for an empty subtree.
+ */
+ static int tree_height(char *node)
+ {
+    return (word_t)node == 0 ? 0 : GET(HEIGHT(node));
+ }
+
+/*
+ * Recompute the height of node from its children.
+ */
+ static void tree_update(char *node)
+ {
+    PUT(HEIGHT(node), MAX(tree_height(GET_LEFT(node)), tree_height(GET_RIGHT(node))) + 1);
+ }
+
+/*
+ * Rotate the subtree at node right or left and return its new root.
+ */
+ static char *tree_rotate_right(char *node)
+ {
+    char *left = GET_LEFT(node);
+    PUT(LEFT(node), GET(RIGHT(left)));
+    PUT(RIGHT(left), (word_t)node);
+    tree_update(node);
+    tree_update(left);
+    return left;
+ }
+
+ static char *tree_rotate_left(char *node)
+ {
+    char *right = GET_RIGHT(node);
+    PUT(RIGHT(node), GET(LEFT(right)));
+    PUT(LEFT(right), (word_t)node);
+    tree_update(node);
+    tree_update(right);
+    return right;
+ }
+
+/*
+ * Restore the AVL balance at node after one of its subtrees changed
+ * height by one, and return the new root of the subtree.
+ */
+ static char *tree_balance(char *node)
+ {
+    int leftHeight = tree_height(GET_LEFT(node));
+    int rightHeight = tree_height(GET_RIGHT(node));
+
+    // left side too deep
+    if (leftHeight > rightHeight + 1){
+        char *left = GET_LEFT(node);
+        if (tree_height(GET_LEFT(left)) < tree_height(GET_RIGHT(left))){
+            PUT(LEFT(node), (word_t)tree_rotate_left(left));
+        }
+        return tree_rotate_right(node);
+    }
+
+    // right side too deep
+    if (rightHeight > leftHeight + 1){
+        char *right = GET_RIGHT(node);
+        if (tree_height(GET_RIGHT(right)) < tree_height(GET_LEFT(right))){
+            PUT(RIGHT(node), (word_t)tree_rotate_right(right));
+        }
+        return tree_rotate_left(node);
+    }
+
+    PUT(HEIGHT(node), MAX(leftHeight, rightHeight) + 1);
+    return node;
+ }
+
+/*
+ * Insert the free block bp into the subtree at root, return the new root.
+ */
+ static char *tree_insert(char *root, char *bp)
+ {
+    if ((word_t)root == 0){
+        PUT(LEFT(bp), 0);
+        PUT(RIGHT(bp), 0);
+        PUT(HEIGHT(bp), 1);
+        return bp;
+    }
+
+    if (TREE_LESS(bp, root)){
+        PUT(LEFT(root), (word_t)tree_insert(GET_LEFT(root), bp));
+    }
+    else{
+        PUT(RIGHT(root), (word_t)tree_insert(GET_RIGHT(root), bp));
+    }
+    return tree_balance(root);
+ }
+
+/*
+ * Unlink the smallest node of the subtree at root into *min and return 
+ * the new root.
+ */
+ static char *tree_remove_min(char *root, char **min)
+ {
+    if ((word_t)GET_LEFT(root) == 0){
+        *min = root;
+        return GET_RIGHT(root);
+    }
+    PUT(LEFT(root), (word_t)tree_remove_min(GET_LEFT(root), min));
+    return tree_balance(root);
+ }
+
+/*
+ * Remove the free block bp from the subtree at root, return the new root.
+ * The block must be in the tree.
+ */
+ static char *tree_remove(char *root, char *bp)
+ {
+    if (root == bp){
+        char *left = GET_LEFT(root);
+        char *right = GET_RIGHT(root);
+        char *min;
+
+        if ((word_t)right == 0){
+            return left;
+        }
+
+        // the next larger block takes the place of bp
+        right = tree_remove_min(right, &min);
+        PUT(LEFT(min), (word_t)left);
+        PUT(RIGHT(min), (word_t)right);
+        return tree_balance(min);
+    }
+
+    if (TREE_LESS(bp, root)){
+        PUT(LEFT(root), (word_t)tree_remove(GET_LEFT(root), bp));
+    }
+    else{
+        PUT(RIGHT(root), (word_t)tree_remove(GET_RIGHT(root), bp));
+    }
+    return tree_balance(root);
+ }
+
+/*
+ * Compute the first and second level indexes of the list for a block
+ * of size bytes.
+ */
+ static void mapping_insert(size_t size, int *fl, int *sl)
+ {
+    if(size < SMALL_BLOCK_SIZE){
+        *fl = 0;
+        *sl = size >> ALIGN_SIZE_LOG2;
+    }
+    else{
+        int bit = FLS(size);
+        *sl = (size >> (bit - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+        *fl = bit - (FL_INDEX_SHIFT - 1);
+    }
+ }
+ 
+/* 
+ * places a block into a block pointer. The block is removed from the free 
+ * list and split into an allocated and free block if it is large enough to
+ * accomodate both.
+ */ 
+ static void place(void *bp, size_t size)
+ {
+    // remove from free list
+    remove_free_list(bp);
+
+    split_block(bp, GET_SIZE(HDRP(bp)), size);
+ }
+
+/*
+ * Mark the first size bytes of the total byte block at bp allocated. If 
+ * what is left is large enough for a free block, it is split off and added 
+ * to the free list. The block must not be on a free list and the block 
+ * after it must be allocated.
+ */
+ static void split_block(void *bp, size_t total, size_t size)
+ {
+    size_t prevAlloc = GET_PREV_ALLOC(HDRP(bp));
+
+    CHECK_CARVE(bp, total);
+
+    //Large enough to hold bp AND a free block 
+    if ((total - size) >= (2*DSIZE)) {
+        PUT(HDRP(bp), PACK(size, 1 | prevAlloc));
+                 
+        void * nextBP = NEXT_BLKP(bp);
+                 
+        PUT(HDRP(nextBP), PACK(total-size, PREV_ALLOC));
+        PUT(FTRP(nextBP), PACK(total-size, 0));
+        CLEAR_PREV_ALLOC(NEXT_BLKP(nextBP));
+                                  
+        //ADD new free block to free list
+        add_free_list(nextBP);
+        arena->splits++;
+
+        // the block and the links of the free part are used now
+        arena->fresh = MAX(arena->fresh, (char *)nextBP + 3*WSIZE);
+    }
+         
+    //not large enough for a free block to remain.
+    else {
+        //set to allocated 
+        PUT(HDRP(bp), PACK(total, 1 | prevAlloc));
+        SET_PREV_ALLOC(NEXT_BLKP(bp));
+        arena->fresh = MAX(arena->fresh, (char *)NEXT_BLKP(bp));
     }
  }
 
 
 /* 
  * remove a pointer to a free block from the list of free blocks.
- * update global values to reflect changes
+ * update global values and bitmaps to reflect changes
  */  
  static void remove_free_list(void *bp){              
+    int fl, sl;
+
     //decrementfree count. 
-    numFree--; 
-         
-    int size = GET_SIZE(HDRP(bp));
-         
-    int minListLocal = size / 50;
-    if(minListLocal > 83){
-        minListLocal = 83;
-    } 
+    arena->numFree--; 
+
+    // large blocks are in the tree
+    if(GET_SIZE(HDRP(bp)) >= LARGE_BLOCK_SIZE){
+        PUT(TREE_ROOT, (word_t)tree_remove((char *)GET(TREE_ROOT), bp));
+        return;
+    }
+
+    mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
          
     // set up prev and next to represent neighbor
     size_t prev = GET(bp);
     size_t next = GET(bp + WSIZE);
 
-    // prev is empty and next is empty;
-    if(prev == 0 && next == 0) { 
-        //set this list pointer to 0 indicating no items on the list. 
-        PUT(heap_listp+(minListLocal * WSIZE), 0);
-                 
-        if(minList == minListLocal) { 
-            if(numFree > 0){
-                int i;
-                for (i = minListLocal; GET(heap_listp+(i * WSIZE)) == 0; i++){
-                    minList = i;
+    // the next fit rover moves on when its block leaves the list
+    if(bp == arena->rover){
+        arena->rover = (char *)next;
+    }
+#ifdef MM_CHECK
+    if(bp == arena->checkEntry){
+        arena->checkEntry = (char *)next;
+    }
+#endif
+
+    // prev is empty and next is empty;
+    if(prev == 0 && next == 0) { 
+        //set this list pointer to 0 indicating no items on the list. 
+        PUT(LIST_HEAD(fl, sl), 0);
+
+        // clear the list bit, and the class bit once the class is empty
+        PUT(SL_BITMAP(fl), GET(SL_BITMAP(fl)) & ~(1U << sl));
+        if(GET(SL_BITMAP(fl)) == 0){
+            PUT(FL_BITMAP, GET(FL_BITMAP) & ~(1U << fl));
+        }
+    }
+         
+    // prev is empty and next is full 
+    else if (prev == 0 && next != 0){
+        PUT(LIST_HEAD(fl, sl), next);
+        PUT((char *)next, 0);
+    }
+         
+    // prev is full and next is empty
+    else if (prev != 0 && next == 0){
+        PUT(((char *)prev + WSIZE), 0);
+    }
+                 
+    // prev is full and next is full
+    else {
+        PUT(((char *)prev + WSIZE), next);        
+        PUT(((char *)next), prev);        
+    }
+ }
+ 
+ 
+ /* 
+ * add a pointer to the front of its free list and update globals and 
+ * bitmaps to reflect changes
+ */  
+ static void add_free_list(void *bp)
+ {     
+    int fl, sl;
+
+    arena->numFree++; 
+
+    // large blocks go in the tree
+    if(GET_SIZE(HDRP(bp)) >= LARGE_BLOCK_SIZE){
+        PUT(TREE_ROOT, (word_t)tree_insert((char *)GET(TREE_ROOT), bp));
+        return;
+    }
+
+    mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+
+    void *tempNext = (char *)GET(LIST_HEAD(fl, sl));
+
+    //push the block on the front of the list
+    PUT(bp, 0); 
+    PUT(bp+WSIZE, (word_t)tempNext);
+    if((word_t)tempNext != 0){
+        PUT(tempNext, (word_t)bp);
+    }
+    PUT(LIST_HEAD(fl, sl), (word_t)bp);        
+
+    // mark the list and its class as non-empty
+    PUT(SL_BITMAP(fl), GET(SL_BITMAP(fl)) | (1U << sl));
+    PUT(FL_BITMAP, GET(FL_BITMAP) | (1U << fl));
+}
+
+/*
+ * Allocate a block of adjSize bytes whose payload is aligned to align bytes,
+ * a power of two. A large enough free block is found and the part in front 
+ * of the aligned payload is split off as a free block of its own.
+ *
+ * Return NULL if the heap is full, otherwise a pointer to the new block.
+ */
+ static void *alloc_aligned(size_t align, size_t adjSize)
+ {
+    // room for the block and a leading free block in front of it
+    size_t searchSize = adjSize + align + 2*DSIZE;
+
+    char *bp = find_fit(searchSize);
+    if (bp == NULL && fast_consolidate()){
+        bp = find_fit(searchSize);
+    }
+    if (bp == NULL){
+        bp = extend_heap(grow_step(searchSize)/WSIZE);
+
+        // the new memory is a segment of its own if another arena grew the heap
+        while (bp != NULL && GET_SIZE(HDRP(bp)) < searchSize){
+            bp = extend_heap(grow_step(searchSize - GET_SIZE(HDRP(bp)))/WSIZE);
+        }
+        if (bp == NULL){
+            return NULL;
+        }
+    }
+    size_t size = GET_SIZE(HDRP(bp));
+
+    // first aligned payload that leaves room for a free block in front of it
+    char *alignp = (char *)(((word_t)bp + (align-1)) & ~(align-1));
+    if (alignp != bp && (alignp - bp) < 2*DSIZE){
+        alignp += align;
+    }
+
+    // split off the leading part as its own free block
+    if (alignp != bp){
+        size_t lead = alignp - bp;
+        remove_free_list(bp);
+        PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(lead, 0));
+        add_free_list(bp);
+
+        PUT(HDRP(alignp), PACK(size - lead, 0));
+        PUT(FTRP(alignp), PACK(size - lead, 0));
+        add_free_list(alignp);
+    }
+
+    place(alignp, adjSize);
+    return alignp;
+ }
+
+/*
+ * Take a slot of size class cls from the first slab on the class list,
+ * making a new slab if the list is empty. A slab that becomes full is taken
+ * off the list.
+ *
+ * Return NULL if the heap is full, otherwise a pointer to the slot.
+ */
+ static void *slab_alloc(int cls)
+ {
+    char *slab = (char *)GET(SLAB_HEAD(cls));
+    char *bp;
+
+    // no slab of this class has a free slot, carve a new one
+    if ((word_t)slab == 0){
+        slab = alloc_aligned(SLAB_SIZE, ADJ_SIZE(SLAB_SIZE));
+        if (slab == NULL){
+            return NULL;
+        }
+        PUT(SLAB_NEXT(slab), 0);
+        PUT(SLAB_PREV(slab), 0);
+        PUT(SLAB_FREE(slab), 0);
+        PUT(SLAB_BUMP(slab), (word_t)SLAB_FIRST(slab));
+        PUT(SLAB_USED(slab), 0);
+        PUT(SLAB_CLS(slab), cls);
+        PUT(SLAB_HEAD(cls), (word_t)slab);
+        SLAB_MARK(slab);
+    }
+
+    // reuse a freed slot, otherwise take the next never used one
+    bp = (char *)GET(SLAB_FREE(slab));
+    if ((word_t)bp != 0){
+        PUT(SLAB_FREE(slab), GET(bp));
+    }
+    else{
+        bp = (char *)GET(SLAB_BUMP(slab));
+        PUT(SLAB_BUMP(slab), (word_t)(bp + SLAB_SLOT(cls)));
+    }
+    PUT(SLAB_USED(slab), GET(SLAB_USED(slab)) + 1);
+
+    // a full slab leaves the front of the list
+    if ((int)GET(SLAB_USED(slab)) == SLAB_SLOTS(cls)){
+        char *next = (char *)GET(SLAB_NEXT(slab));
+        PUT(SLAB_HEAD(cls), (word_t)next);
+        if ((word_t)next != 0){
+            PUT(SLAB_PREV(next), 0);
+        }
+    }
+    return bp;
+ }
+
+/*
+ * Return a slot to its slab. A full slab goes back on its class list, and
+ * an empty slab is given back to the heap unless it is the last one on the
+ * list.
+ */
+ static void slab_free(void *bp)
+ {
+    char *slab = SLAB_PAGE(bp);
+    int cls = GET(SLAB_CLS(slab));
+    int used = GET(SLAB_USED(slab));
+
+    PUT(bp, GET(SLAB_FREE(slab)));
+    PUT(SLAB_FREE(slab), (word_t)bp);
+    PUT(SLAB_USED(slab), used - 1);
+
+    char *next = (char *)GET(SLAB_NEXT(slab));
+    char *prev = (char *)GET(SLAB_PREV(slab));
+
+    // the slab was full, so it is not on the list
+    if (used == SLAB_SLOTS(cls)){
+        next = (char *)GET(SLAB_HEAD(cls));
+        PUT(SLAB_NEXT(slab), (word_t)next);
+        PUT(SLAB_PREV(slab), 0);
+        if ((word_t)next != 0){
+            PUT(SLAB_PREV(next), (word_t)slab);
+        }
+        PUT(SLAB_HEAD(cls), (word_t)slab);
+    }
+
+    // the slab is empty and has neighbors on the list, give it back
+    else if (used == 1 && ((word_t)next != 0 || (word_t)prev != 0)){
+        if ((word_t)prev != 0){
+            PUT(SLAB_NEXT(prev), (word_t)next);
+        }
+        else{
+            PUT(SLAB_HEAD(cls), (word_t)next);
+        }
+        if ((word_t)next != 0){
+            PUT(SLAB_PREV(next), (word_t)prev);
+        }
+        SLAB_UNMARK(slab);
+        release_block(slab);
+    }
+ }
+
+/*
+ * Put the freed block bp of size bytes, FAST_MIN to FAST_MAX, on the fast
+ * bin of its size. It stays allocated and is not coalesced until the bins
+ * hold more than FAST_LIMIT bytes. Works on the current arena.
+ */
+ static void fast_put(void *bp, size_t size)
+ {
+    PUT(bp, GET(FAST_HEAD(FAST_BIN(size))));
+    PUT(FAST_HEAD(FAST_BIN(size)), (word_t)bp);
+    arena->fastBytes += size;
+
+    if (arena->fastBytes > FAST_LIMIT){
+        fast_consolidate();
+    }
+ }
+
+/*
+ * Take the block freed last from the fast bin of block size size.
+ *
+ * Return NULL if the bin is empty.
+ */
+ static void *fast_get(size_t size)
+ {
+    char *bp = (char *)GET(FAST_HEAD(FAST_BIN(size)));
+
+    if ((word_t)bp == 0){
+        return NULL;
+    }
+    PUT(FAST_HEAD(FAST_BIN(size)), GET(bp));
+    arena->fastBytes -= size;
+    return bp;
+ }
+
+/*
+ * Free and coalesce every block in the fast bins of the current arena.
+ *
+ * Return 0 if the bins were empty, 1 otherwise.
+ */
+ static int fast_consolidate(void)
+ {
+    char *bp, *next;
+    int bin;
+
+    if (arena->fastBytes == 0){
+        return 0;
+    }
+    for (bin = 0; bin < FAST_BINS; bin++){
+        bp = (char *)GET(FAST_HEAD(bin));
+        PUT(FAST_HEAD(bin), 0);
+        for (; (word_t)bp != 0; bp = next){
+            next = (char *)GET(bp);
+            release_block(bp);
+        }
+    }
+    arena->fastBytes = 0;
+    return 1;
+ }
+
+/////////// Realloc slack /////////////////
+
+/* 
+ * Each thread remembers the blocks its reallocs grew last, GROW_SLOTS of
+ * them by address. From the GROW_MIN-th grow in a row on, a block is given
+ * half its size again as slack, at most SLACK_MAX bytes, so that the next 
+ * grows fit in place.
+ */
+ #define GROW_SLOTS 8
+ #define GROW_SLOT(bp) (((word_t)(bp) / DSIZE) % GROW_SLOTS)
+ #define GROW_FORGET(p) (growTrack[GROW_SLOT(p)].bp == (char *)(p) ? \
+                         (void)(growTrack[GROW_SLOT(p)].bp = NULL) : (void)0)
+ #define GROW_MIN 2
+ #define SLACK_MAX (1 << 16)
+
+typedef struct {
+    char *bp;                // block returned by a growing realloc
+    size_t size;             // size it was asked for
+    int grows;               // grows in a row
+} grow_t;
+
+static THREAD_LOCAL grow_t growTrack[GROW_SLOTS];
+
+/*
+ * free a block pointed to by bp, in the arena that owns it. A block of
+ * another thread's arena is handed to that arena without its lock.
+ */
+void mm_free(void *bp)
+{
+    if (bp == NULL){
+        return;
+    }
+
+    // a freed block stops growing
+    GROW_FORGET(bp);
+
+#ifdef TCACHE
+    // small blocks stay allocated in the thread cache, by slot or block size
+    if (tcache_put(bp, IS_SLAB(bp) ? SLAB_SLOT(GET(SLAB_CLS(SLAB_PAGE(bp))))
+                                   : GET_SIZE(HDRP(bp)))){
+        return;
+    }
+#endif
+
+    // mapped blocks go straight back to the system
+    if (!IS_SLAB(bp) && IS_MAPPED(bp)){
+        mapped_free(bp);
+        return;
+    }
+
+#ifdef MM_THREADS
+    if (arena_of(bp) != thread_arena()){
+        remote_free(arena_of(bp), bp);
+        return;
+    }
+#endif
+
+    arena_lock(arena_of(bp));
+    free_block(bp);
+    arena_unlock();
+}
+
+/*
+ * free the block bp, for which the caller asked size bytes by malloc or by
+ * the last realloc of the block. The size picks the slab class, cache bin
+ * or fast bin of a small block without reading its header; other blocks 
+ * take the mm_free path. Built with DEBUG the size is checked against the 
+ * block.
+ */
+void mm_free_sized(void *bp, size_t size)
+{
+    size_t adjSize = ADJ_SIZE(size);
+    int slab;
+
+    if (bp == NULL){
+        return;
+    }
+    slab = IS_SLAB(bp);
+#ifdef DEBUG
+    assert(slab ? size <= SLAB_SLOT(GET(SLAB_CLS(SLAB_PAGE(bp))))
+                : adjSize <= GET_SIZE(HDRP(bp)));
+#endif
+
+    // the size alone tells nothing about mapped blocks and other sizes
+    if (slab ? size == 0 : (adjSize < FAST_MIN || adjSize > FAST_MAX || !IN_HEAP(bp))){
+        mm_free(bp);
+        return;
+    }
+    GROW_FORGET(bp);
+
+    // a slot may be in a larger class than the size, a block may be larger
+    // than its size, and both are binned as if they were not
+    if (slab){
+        adjSize = SLAB_SLOT(SLAB_CLASS(size));
+    }
+
+#ifdef TCACHE
+    if (tcache_put(bp, adjSize)){
+        return;
+    }
+#endif
+
+#ifdef MM_THREADS
+    if (arena_of(bp) != thread_arena()){
+        remote_free(arena_of(bp), bp);
+        return;
+    }
+#endif
+
+    arena_lock(arena_of(bp));
+    arena->frees++;
+    if (slab){
+        slab_free(bp);
+    }
+    else{
+        fast_put(bp, adjSize);
+    }
+    arena_unlock();
+}
+
+/*
+ * free a block pointed to by bp. Slab slots go back to their slab and 
+ * small blocks to the fast bins. Works on the current arena.
+ */
+ static void free_block(void *bp)
+ {
+    arena->frees++;
+
+    // slab slots have no header
+    if (IS_SLAB(bp)){
+        slab_free(bp);
+        return;
+    }
+        
+    size_t size = GET_SIZE(HDRP(bp));
+    if (size >= FAST_MIN && size <= FAST_MAX){
+        fast_put(bp, size);
+        return;
+    }
+    release_block(bp);
+ }
+
+/*
+ * free the allocated block bp for good and
+ * coalesce to save time in searches. Works on the current arena.
+ */
+ static void release_block(void *bp)
+ {
+    size_t size = GET_SIZE(HDRP(bp));
+
+    //set header and footer, the next block now follows a free block
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(size, 0));
+    CLEAR_PREV_ALLOC(NEXT_BLKP(bp));
+        
+    heap_trim(coalesce(bp));
+ }
+
+ /* 
+ * combine neighboring free blocks and put the resulting 
+ * free block in the free list. The merged block keeps the previous 
+ * allocated bit of its first block.
+ */  
+ static void *coalesce(void *bp)
+ {
+    size_t prevAlloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t nextAlloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    // one merge for each free neighbor
+    arena->coalesces += !prevAlloc + !nextAlloc;
+
+    //previous block is free and next block is free 
+    if(!prevAlloc && !nextAlloc) {  
+        remove_free_list(PREV_BLKP(bp));
+        remove_free_list(NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        bp = PREV_BLKP(bp);
+        PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(size, 0));
+        add_free_list(bp);
+    }
+
+    //previous block is free but next block is allocated 
+    else if (!prevAlloc && nextAlloc) { 
+        remove_free_list(PREV_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        bp = PREV_BLKP(bp);
+        PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(size, 0));
+        add_free_list(bp);
+    }
+
+    // previous block is allocated but next block is free 
+    else if (prevAlloc && !nextAlloc) {
+        remove_free_list(NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size,0));
+        add_free_list(bp);
+    }
+    // previous block is allocated and next block is allocated
+    else {  
+        add_free_list(bp);
+    }
+    CHECK_CARVE(bp, size);
+    return bp;
+ }
+
+/*
+ * Reallocate a block of memory to a new size
+ * if ptr is null, behave as mm_maloc
+ * if size == 0, behave as free
+ *    
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    void *newptr;
+    size_t copySize;
+    size_t slack = 0;
+    grow_t *g;
+    int grows;
+
+    // if size is 0, just call mm_free
+    if (size == 0){
+        mm_free(ptr);
+        return NULL;
+    }
+    
+    //if pointer is NULL, just call mm_malloc
+    if (ptr == NULL){        
+        return mm_malloc(size);
+    }
+
+    // no block can be that large, and the sums below would wrap
+    if (size > MAPPED_MAX - SLACK_MAX){
+        return NULL;
+    }
+
+    if (!IS_SLAB(ptr) && IS_MAPPED(ptr)){
+        return mapped_realloc(ptr, size);
+    }
+
+    // payload bytes the block can hold now
+    if (IS_SLAB(ptr)){
+        copySize = SLAB_SLOT(GET(SLAB_CLS(SLAB_PAGE(ptr))));
+    }
+    else{
+        copySize = GET_SIZE(HDRP(ptr)) - WSIZE;
+    }
+
+    // a block that keeps growing gets slack when it moves and keeps it 
+    // while it grows into it, one that shrinks gives it back
+    g = &growTrack[GROW_SLOT(ptr)];
+    if (g->bp == ptr && size <= g->size){
+        g->bp = NULL;
+        grows = 0;
+    }
+    else{
+        grows = (g->bp == ptr) ? g->grows + 1 : 1;
+        if (grows > 1 && size <= copySize){
+            grow_track(ptr, size, grows);
+            return ptr;
+        }
+        if (grows >= GROW_MIN){
+            slack = MIN(size / 2, SLACK_MAX);
+        }
+    }
+
+    // resize in place or into the neighbors, in the arena that owns the block
+    arena_lock(arena_of(ptr));
+    arena->reallocs++;
+    newptr = realloc_block(ptr, size);
+    arena_unlock();
+    if (newptr != NULL){
+        grow_track(newptr, size, grows);
+        return newptr;
+    }
+
+    // otherwise move the block
+    if (size < copySize){
+        copySize = size;
+    }
+
+    newptr = mm_malloc(size + slack);
+    if (newptr == NULL){
+        return NULL;
+    }
+    memcpy(newptr, ptr, copySize);   
+    mm_free(ptr);
+    grow_track(newptr, size, grows);
+    return newptr;
+}
+
+/*
+ * Remember that a realloc to size bytes returned bp, the grows-th grow 
+ * of the block in a row. A realloc that did not grow the block forgets it.
+ */
+ static void grow_track(void *bp, size_t size, int grows)
+ {
+    grow_t *g = &growTrack[GROW_SLOT(bp)];
+
+    if (grows > 0){
+        g->bp = bp;
+        g->size = size;
+        g->grows = grows;
+    }
+    else if (g->bp == bp){
+        g->bp = NULL;
+    }
+ }
+
+/*
+ * Resize the block at oldptr without moving it, or by merging it with free
+ * neighbors, or by growing the heap when it is the last block. Works on the
+ * current arena.
+ *
+ * Return the resized block, or NULL if the block has to move.
+ */
+ static void *realloc_block(void *oldptr, size_t size)
+ {
+    void *ptr = oldptr;
+    void *newptr;
+
+    // a slab slot keeps its place while the size still fits the slot
+    if (IS_SLAB(oldptr)){
+        if (size <= SLAB_SLOT(GET(SLAB_CLS(SLAB_PAGE(oldptr))))){
+            return oldptr;
+        }
+        return NULL;
+    }
+    
+    size_t prevAlloc = GET_PREV_ALLOC(HDRP(oldptr));
+    size_t nextAlloc = GET_ALLOC(HDRP(NEXT_BLKP(oldptr)));
+    
+    size_t oldSize = GET_SIZE(HDRP(oldptr));
+
+    int change;
+    
+    //is new size is larger?
+    if(oldSize  < size + WSIZE){ 
+        change = 1;
+    }
+    else{
+        change = 0;
+    }
+
+    // adjust block size       
+    size_t adjSize = ADJ_SIZE(size);
+
+    // ptr is decreasing in size and there is enough leaft over space to make a free block
+    if(change == 0 && (oldSize - adjSize) > (2*DSIZE)){
+        //reset header
+        PUT(HDRP(oldptr), PACK(adjSize, 1 | prevAlloc)); 
+
+        newptr = oldptr;
+        oldptr =  (NEXT_BLKP(newptr)); 
+            
+        //set header and footer for the empty block
+        PUT(HDRP(oldptr), PACK(oldSize - adjSize, PREV_ALLOC));
+        PUT(FTRP(oldptr), PACK(oldSize - adjSize, 0));
+        CLEAR_PREV_ALLOC(NEXT_BLKP(oldptr));
+          
+        heap_trim(coalesce(oldptr));
+        
+        return newptr;
+    }
+
+    // ptr is decreasing in size but there isnt enough after to make a free block
+    if(change == 0) {
+        return ptr;
+    }
+    
+    // ptr is increasing in size
+    else {
+
+        // the previous block's size is only known when it is free
+        size_t tempPrev = prevAlloc ? 0 : GET_SIZE(HDRP(PREV_BLKP(oldptr)));
+        size_t tempNext = GET_SIZE(HDRP(NEXT_BLKP(oldptr)));
+
+        // next and prev are unallocated and will create a large enough block 
+        if (nextAlloc == 0 && prevAlloc == 0 && (tempPrev + tempNext + oldSize) >= adjSize){
+            newptr = PREV_BLKP(oldptr);
+            //remove from free list since they will combine into 1
+            remove_free_list(PREV_BLKP(oldptr));
+            remove_free_list(NEXT_BLKP(oldptr));
+
+            // the payloads overlap
+            memmove(newptr, oldptr, oldSize - WSIZE);
+            split_block(newptr, tempPrev + tempNext + oldSize, adjSize);
+            return newptr;                                       
+        }   
+
+        // prev is unallocated and will create a large enough block when combined
+        else if(prevAlloc == 0 && (tempPrev + oldSize) >= adjSize){
+            newptr = PREV_BLKP(oldptr);
+            remove_free_list(PREV_BLKP(oldptr));
+
+            memmove(newptr, oldptr, oldSize - WSIZE);
+            split_block(newptr, tempPrev + oldSize, adjSize);
+            return newptr;            
+        }             
+                
+        // next is unallocated and will create a large enough block
+        else if(nextAlloc == 0 && (tempNext + oldSize) >= adjSize){
+            remove_free_list(NEXT_BLKP(oldptr));
+
+            split_block(oldptr, tempNext + oldSize, adjSize);
+            return oldptr;                            
+        }
+
+        // the block ends the heap, or only a free block follows it: grow 
+        // the heap by the shortfall and take the new space in place
+        else if(NEXT_BLKP(oldptr) == arena->top || 
+                (nextAlloc == 0 && NEXT_BLKP(NEXT_BLKP(oldptr)) == arena->top)){
+            size_t have = oldSize + (nextAlloc ? 0 : tempNext);
+            if (extend_heap(grow_step(MAX(adjSize - have, 2*DSIZE)) / WSIZE) == NULL){
+                return NULL;
+            }
+
+            // the new space is now the free block after ptr, unless another
+            // arena took the memory in between
+            newptr = NEXT_BLKP(oldptr);
+            tempNext = GET_SIZE(HDRP(newptr));
+            if (GET_ALLOC(HDRP(newptr)) == 0 && (tempNext + oldSize) >= adjSize){
+                remove_free_list(newptr);
+                split_block(oldptr, tempNext + oldSize, adjSize);
+                return oldptr;
+            }
+            return NULL;
+        }
+
+        //prev and next are already allocated
+        else{         
+            return NULL;
+        }
+    }
+ }
+
+/////////// Batches /////////////////
+
+/*
+ * Allocate n blocks of size bytes into out[0] to out[n-1]. Heap blocks 
+ * are cut one after the other from a single free block, which is taken 
+ * off its list once. Slab slots, and batches that find no free block large
+ * enough for all of them, are allocated one at a time under one lock; the
+ * heap is not grown for a whole batch while smaller free blocks are left.
+ *
+ * Return the number of blocks allocated, less than n if the heap is full.
+ */
+int mm_malloc_batch(size_t size, int n, void **out)
+{
+    size_t adjSize;
+    size_t left, prevAlloc;
+    char *bp = NULL;
+    int i = 0;
+
+    if (size == 0 || n <= 0){
+        return 0;
+    }
+
+    // huge blocks get a mapping each
+    if (size >= mmapThreshold){
+        for (; i < n && (out[i] = mm_malloc(size)) != NULL; i++)
+            ;
+        return i;
+    }
+    if (size > MAX_HEAP){
+        return 0;
+    }
+    adjSize = ADJ_SIZE(size);
+
+    arena_lock(thread_arena());
+    if (arena->index == NULL && arena_init() < 0){
+        arena_unlock();
+        return 0;
+    }
+
+    // one free block for the whole batch, unless it could never fit the heap
+    if (size > SLAB_MAX && (size_t)n <= MAX_HEAP / adjSize){
+        bp = find_fit(adjSize * n);
+        if (bp == NULL && fast_consolidate()){
+            bp = find_fit(adjSize * n);
+        }
+    }
+
+    if (bp != NULL){
+        left = GET_SIZE(HDRP(bp));
+        prevAlloc = GET_PREV_ALLOC(HDRP(bp));
+        remove_free_list(bp);
+
+        // cut the blocks off the front, the last one splits off the rest
+        for (; i < n - 1; i++){
+            PUT(HDRP(bp), PACK(adjSize, 1 | prevAlloc));
+            out[i] = bp;
+            bp = NEXT_BLKP(bp);
+            left -= adjSize;
+            prevAlloc = PREV_ALLOC;
+        }
+        PUT(HDRP(bp), PACK(left, prevAlloc));
+        split_block(bp, left, adjSize);
+        out[i++] = bp;
+    }
+
+    for (; i < n && (out[i] = malloc_block(size)) != NULL; i++)
+        ;
+    arena->mallocs += i;
+    arena_unlock();
+    return i;
+}
+
+/*
+ * Order block pointers by address for qsort.
+ */
+ static int ptr_cmp(const void *a, const void *b)
+ {
+    char *x = *(char **)a;
+    char *y = *(char **)b;
+
+    return (x > y) - (x < y);
+ }
+
+/*
+ * Free the n blocks in ptrs, which is sorted by address in place. Blocks 
+ * of the batch that follow each other in the heap are merged into one 
+ * free block, which is coalesced and put on a list once. The blocks skip 
+ * the thread cache and the fast bins.
+ */
+void mm_free_batch(void **ptrs, int n)
+{
+    char *bp;
+    size_t size;
+    int i;
+
+    if (n <= 0){
+        return;
+    }
+    qsort(ptrs, n, sizeof(void *), ptr_cmp);
+
+    arena_lock(thread_arena());
+    for (i = 0; i < n; i++){
+        bp = ptrs[i];
+        if (bp == NULL){
+            continue;
+        }
+        GROW_FORGET(bp);
+
+        if (!IS_SLAB(bp) && IS_MAPPED(bp)){
+            mapped_free(bp);
+            continue;
+        }
+#ifdef MM_THREADS
+        if (arena_of(bp) != arena){
+            remote_free(arena_of(bp), bp);
+            continue;
+        }
+#endif
+        arena->frees++;
+        if (IS_SLAB(bp)){
+            slab_free(bp);
+            continue;
+        }
+
+        // take in the blocks of the batch right behind bp
+        size = GET_SIZE(HDRP(bp));
+        while (i + 1 < n && (char *)ptrs[i + 1] == bp + size){
+            i++;
+            arena->frees++;
+            GROW_FORGET((char *)ptrs[i]);
+            size += GET_SIZE(HDRP(ptrs[i]));
+        }
+        PUT(HDRP(bp), PACK(size, 1 | GET_PREV_ALLOC(HDRP(bp))));
+        CHECK_CARVE(bp, size);
+        release_block(bp);
+    }
+    arena_unlock();
+}
+
+/////////// Statistics /////////////////
+
+/*
+ * Fill in the placement policy and the free block search counters of all 
+ * arenas since mm_init. The counters of other threads' arenas are read 
+ * without their locks, so they may be a little behind.
+ */
+void mm_fit_stats(mm_fit_t *stats)
+{
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->policy = fitPolicies[fitPolicy];
+    for (i = 0; i < MM_ARENAS; i++){
+        stats->searches += arenas[i].fitSearches;
+        stats->examined += arenas[i].fitExamined;
+        stats->misses += arenas[i].fitMisses;
+        stats->slack += arenas[i].fitSlack;
+    }
+}
+
+/* The lists and the tree of every arena share the bins of mm_stats */
+#if FL_INDEX_COUNT*SL_INDEX_COUNT >= MM_STATS_BINS
+ #error "mm_stats has fewer bins than there are free lists"
+#endif
+
+/*
+ * Fill in the heap statistics: the free blocks on each list and in the 
+ * tree of all arenas, which are walked under their locks, and the 
+ * operation counters since mm_init.
+ */
+void mm_stats(mm_stats_t *stats)
+{
+    arena_t *self = arena;
+    int i, fl, sl, bin;
+    char *bp;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->nbins = FL_INDEX_COUNT*SL_INDEX_COUNT + 1;
+    for (fl = 0; fl < FL_INDEX_COUNT; fl++){
+        for (sl = 0; sl < SL_INDEX_COUNT; sl++){
+            stats->bins[fl*SL_INDEX_COUNT + sl].size = (fl == 0) ? (size_t)sl << ALIGN_SIZE_LOG2 :
+                (size_t)(SL_INDEX_COUNT + sl) << (fl + FL_INDEX_SHIFT - 1 - SL_INDEX_COUNT_LOG2);
+        }
+    }
+    stats->bins[stats->nbins - 1].size = LARGE_BLOCK_SIZE;
+
+    for (i = 0; i < MM_ARENAS; i++){
+        arena = &arenas[i];
+        LOCK(&arena->lock);
+        if (arena->index != NULL){
+            for (bin = 0; bin < stats->nbins - 1; bin++){
+                bp = (char *)GET(LIST_HEAD(bin / SL_INDEX_COUNT, bin % SL_INDEX_COUNT));
+                for (; (word_t)bp != 0; bp = (char *)GET(bp + WSIZE)){
+                    stats->bins[bin].count++;
+                    stats->bins[bin].bytes += GET_SIZE(HDRP(bp));
+                    stats->largest = MAX(stats->largest, GET_SIZE(HDRP(bp)));
                 }
             }
-            else(minList = 100);                         
+            stats_tree((char *)GET(TREE_ROOT), stats);
+            stats->cached += arena->fastBytes;
         }
+        stats->mallocs += arena->mallocs;
+        stats->frees += arena->frees;
+        stats->reallocs += arena->reallocs;
+        stats->splits += arena->splits;
+        stats->coalesces += arena->coalesces;
+        stats->extends += arena->extends;
+        UNLOCK(&arena->lock);
     }
-         
-    // prev is empty and next is full 
-    else if (prev == 0 && next != 0){
-        PUT(heap_listp+(minListLocal * WSIZE), next);
-        PUT((char *)next, 0);
+    arena = self;
+
+    for (bin = 0; bin < stats->nbins; bin++){
+        stats->numFree += stats->bins[bin].count;
+        stats->free += stats->bins[bin].bytes;
     }
-         
-    // prev is full and next is empty
-    else if (prev != 0 && next == 0){
-        PUT(((char *)prev + WSIZE), 0);
+
+#ifdef MM_THREADS
+    LOCK(&memLock);
+#endif
+    stats->heap = mem_heapsize();
+    stats->mapped = mem_mapsize();
+    stats->mallocs += mapMallocs;
+    stats->frees += mapFrees;
+    stats->reallocs += mapReallocs;
+#ifdef MM_THREADS
+    UNLOCK(&memLock);
+#endif
+    stats->live = stats->heap + stats->mapped - stats->free - stats->cached;
+}
+
+/*
+ * Add the free blocks of the subtree at node to the last bin of stats.
+ */
+ static void stats_tree(char *node, mm_stats_t *stats)
+ {
+    if ((word_t)node == 0){
+        return;
     }
-                 
-    // prev is full and next is full
-    else {
-        PUT(((char *)prev + WSIZE), next);        
-        PUT(((char *)next), prev);        
+    stats->bins[stats->nbins - 1].count++;
+    stats->bins[stats->nbins - 1].bytes += GET_SIZE(HDRP(node));
+    stats->largest = MAX(stats->largest, GET_SIZE(HDRP(node)));
+    stats_tree(GET_LEFT(node), stats);
+    stats_tree(GET_RIGHT(node), stats);
+ }
+
+/////////// Control /////////////////
+
+/* Tunables of mm_ctl "opt" names: the variable, and the least value allowed */
+static const struct {
+    const char *name;
+    size_t *value;
+    size_t least;
+} ctlSizes[] = {
+    {"chunk_size", &chunkSize, 2*DSIZE},
+    {"grow_max", &growMax, 2*DSIZE},
+    {"mmap_threshold", &mmapThreshold, 0},
+    {"trim_threshold", &trimThreshold, 4*DSIZE},
+};
+
+/* mm_stats fields of mm_ctl "stats" names */
+ #define CTL_STAT(name, field) {name, offsetof(mm_stats_t, field), sizeof(((mm_stats_t *)0)->field)}
+static const struct {
+    const char *name;
+    size_t offset;
+    size_t size;
+} ctlStats[] = {
+    CTL_STAT("heap", heap),
+    CTL_STAT("mapped", mapped),
+    CTL_STAT("live", live),
+    CTL_STAT("free_bytes", free),
+    CTL_STAT("cached", cached),
+    CTL_STAT("largest", largest),
+    CTL_STAT("free_blocks", numFree),
+    CTL_STAT("nbins", nbins),
+    CTL_STAT("mallocs", mallocs),
+    CTL_STAT("frees", frees),
+    CTL_STAT("reallocs", reallocs),
+    CTL_STAT("splits", splits),
+    CTL_STAT("coalesces", coalesces),
+    CTL_STAT("extends", extends),
+};
+
+ #define CTL_COUNT(table) ((int)(sizeof(table) / sizeof(table[0])))
+
+/*
+ * Copy the size byte value to oldp if oldp is set, and store the size in
+ * *oldlenp if that is set. *oldlenp must be the size for a copy.
+ *
+ * Return 0, or EINVAL if the lengths do not match.
+ */
+ static int ctl_read(void *oldp, size_t *oldlenp, const void *value, size_t size)
+ {
+    if (oldp != NULL){
+        if (oldlenp == NULL || *oldlenp != size){
+            return EINVAL;
+        }
+        memcpy(oldp, value, size);
+    }
+    if (oldlenp != NULL){
+        *oldlenp = size;
+    }
+    return 0;
+ }
+
+/*
+ * Read the name in the name space of mm.h, and write it if newp is set. 
+ * A value is read into oldp, whose length is *oldlenp, and written from 
+ * newp, whose length is newlen; both lengths must be the size of the 
+ * value. A name that does something, like a purge, is written with no 
+ * value. New settings hold for what the allocator does from then on, 
+ * and stay in force across mm_init. They are written with every arena 
+ * locked, so no arena sees one change in the middle of an operation.
+ *
+ * Return 0 on success, ENOENT for an unknown name, EPERM for a write to 
+ * a read-only name and EINVAL for a bad length or value.
+ */
+int mm_ctl(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen)
+{
+    mm_stats_t stats;
+    char *end;
+    int i, err;
+    long n;
+
+    if (name == NULL){
+        return ENOENT;
+    }
+
+    if (strncmp(name, "opt.", 4) == 0){
+        name += 4;
+        for (i = 0; i < CTL_COUNT(ctlSizes); i++){
+            if (strcmp(name, ctlSizes[i].name) != 0){
+                continue;
+            }
+            if ((err = ctl_read(oldp, oldlenp, ctlSizes[i].value, sizeof(size_t))) != 0){
+                return err;
+            }
+            if (newp != NULL){
+                size_t value = *(size_t *)newp;
+                if (newlen != sizeof(size_t) || value < ctlSizes[i].least || value % DSIZE != 0){
+                    return EINVAL;
+                }
+                ctl_lock_all(1);
+                *ctlSizes[i].value = value;
+                ctl_lock_all(0);
+            }
+            return 0;
+        }
+        if (strcmp(name, "search_cap") == 0){
+            if ((err = ctl_read(oldp, oldlenp, &fitSearchCap, sizeof(int))) != 0){
+                return err;
+            }
+            if (newp != NULL){
+                if (newlen != sizeof(int)){
+                    return EINVAL;
+                }
+                ctl_lock_all(1);
+                fitSearchCap = *(int *)newp;
+                ctl_lock_all(0);
+            }
+            return 0;
+        }
+        if (strcmp(name, "policy") == 0){
+            if ((err = ctl_read(oldp, oldlenp, &fitPolicies[fitPolicy], sizeof(char *))) != 0){
+                return err;
+            }
+            if (newp == NULL){
+                return 0;
+            }
+#ifdef FIT_POLICY
+            return EPERM;
+#else
+            if (newlen != sizeof(char *)){
+                return EINVAL;
+            }
+            for (i = 0; i < CTL_COUNT(fitPolicies); i++){
+                if (strcmp(*(const char **)newp, fitPolicies[i]) == 0){
+                    ctl_lock_all(1);
+                    fitPolicy = i;
+                    ctl_lock_all(0);
+                    return 0;
+                }
+            }
+            return EINVAL;
+#endif
+        }
+        return ENOENT;
     }
- }
- 
- 
- /* 
- * add a pointer to the free list and update globals to reflect changes
- */  
- static void add_free_list(void *bp)
- {     
-    numFree++; 
-       
-    int size = GET_SIZE(HDRP(bp));
-    int minListLocal = size / 50;
 
-    if(minListLocal > 83){
-        minListLocal = 83;
+    if (strcmp(name, "arenas.narenas") == 0){
+        i = MM_ARENAS;
+        return (newp != NULL) ? EPERM : ctl_read(oldp, oldlenp, &i, sizeof(int));
     }
-    
-    //update global minList
-    if(minList > minListLocal || minList == 100){
-        minList = minListLocal;
+
+    // stats are read only, and taken afresh for every read
+    if (strncmp(name, "stats.", 6) == 0){
+        name += 6;
+        if (newp != NULL){
+            return EPERM;
+        }
+        for (i = 0; i < CTL_COUNT(ctlStats); i++){
+            if (strcmp(name, ctlStats[i].name) == 0){
+                mm_stats(&stats);
+                return ctl_read(oldp, oldlenp, (char *)&stats + ctlStats[i].offset, ctlStats[i].size);
+            }
+        }
+
+        // stats.bins.<i>.size, .count or .free_bytes
+        if (strncmp(name, "bins.", 5) != 0){
+            return ENOENT;
+        }
+        n = strtol(name + 5, &end, 10);
+        if (end == name + 5 || *end != '.' || n < 0 || n >= FL_INDEX_COUNT*SL_INDEX_COUNT + 1){
+            return ENOENT;
+        }
+        mm_stats(&stats);
+        if (strcmp(end, ".size") == 0){
+            return ctl_read(oldp, oldlenp, &stats.bins[n].size, sizeof(size_t));
+        }
+        if (strcmp(end, ".count") == 0){
+            return ctl_read(oldp, oldlenp, &stats.bins[n].count, sizeof(unsigned long));
+        }
+        if (strcmp(end, ".free_bytes") == 0){
+            return ctl_read(oldp, oldlenp, &stats.bins[n].bytes, sizeof(size_t));
+        }
+        return ENOENT;
     }
-        
-    void *tempNext;
-    void *tempPrev;
-  
-    void *tempCurrent = (char *)GET(heap_listp + (minListLocal * WSIZE));
-        
-    //free list is empty 
-    if(tempCurrent == 0){
-        PUT(heap_listp + (minListLocal * WSIZE), (int)bp);        
-        PUT(bp, 0); 
-        PUT(bp+WSIZE, 0);
+
+    // the calling thread's cache goes back to the arenas
+    if (strcmp(name, "thread.tcache.flush") == 0){
+        if (oldp != NULL || newp != NULL){
+            return EINVAL;
+        }
+#ifdef TCACHE
+        if (tcache.epoch == heapEpoch){
+            for (i = 0; i < TCACHE_BINS; i++){
+                tcache_flush(i, 0);
+            }
+        }
+#endif
+        return 0;
     }
-        
-    //the list is not free
-    else {
-        tempPrev = (char *)GET(heap_listp + (minListLocal * WSIZE));
-        //find where to put the free block        
-        for (; (int)tempCurrent != 0 && GET_SIZE(HDRP(tempCurrent)) < size; tempCurrent = (char *)GET(tempCurrent+WSIZE)){
-            tempPrev = tempCurrent;
+
+    // arena.<i>.purge or arena.all.purge, which take no value
+    if (strncmp(name, "arena.", 6) == 0){
+        if (strncmp(name + 6, "all.", 4) == 0){
+            end = (char *)name + 9;
+            n = -1;
         }
-            
-        tempCurrent = tempPrev;
-        tempNext = (char *)GET(tempCurrent + WSIZE); 
-        PUT(tempCurrent + WSIZE, (int)bp); 
-        if((int)tempNext != 0){
-            PUT(tempNext, (int)bp);
+        else{
+            n = strtol(name + 6, &end, 10);
+            if (end == name + 6 || n < 0 || n >= MM_ARENAS){
+                return ENOENT;
+            }
+        }
+        if (strcmp(end, ".purge") != 0){
+            return ENOENT;
+        }
+        if (oldp != NULL || newp != NULL){
+            return EINVAL;
+        }
+        for (i = 0; i < MM_ARENAS; i++){
+            if (n < 0 || n == i){
+                arena_purge(&arenas[i]);
+            }
         }
-        //set pointers to this block
-        PUT(bp, (int)tempCurrent); 
-        PUT(bp+WSIZE, (int)tempNext);          
+        return 0;
     }
+
+    return ENOENT;
 }
 
 /*
- * free a block pointed to by bp
- * coalesce to save time in searches.
+ * Lock all arenas, in order, if lock is set, and unlock them otherwise.
  */
-void mm_free(void *bp)
-{
-        
-    size_t size = GET_SIZE(HDRP(bp));
+ static void ctl_lock_all(int lock)
+ {
+    int i;
 
-    //set header and footer    
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
-        
-    coalesce(bp);
-}
+    for (i = 0; i < MM_ARENAS; i++){
+        if (lock){
+            LOCK(&arenas[i].lock);
+        }
+        else{
+            UNLOCK(&arenas[i].lock);
+        }
+    }
+ }
 
- /* 
- * combine neighboring free blocks and put the resulting 
- * free block in the free list
- */  
- static void *coalesce(void *bp)
+/*
+ * Coalesce the fast bins of arena a, and if a free block of a ends the 
+ * heap give all but a minimal free block of it back to the system.
+ */
+ static void arena_purge(arena_t *a)
  {
-    size_t prevAlloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-    size_t nextAlloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-    size_t size = GET_SIZE(HDRP(bp));
+    arena_t *self = arena;
 
-    //previous block is free and next block is free 
-    if(!prevAlloc && !nextAlloc) {  
-        remove_free_list(PREV_BLKP(bp));
-        remove_free_list(NEXT_BLKP(bp));
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        PUT(FTRP(PREV_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);
-        add_free_list(bp);
+    arena_lock(a);
+    if (arena->index != NULL){
+        fast_consolidate();
+        if (GET_PREV_ALLOC(HDRP(arena->top)) == 0){
+            heap_release(PREV_BLKP(arena->top), 2*DSIZE);
+        }
     }
+    arena_unlock();
+    arena = self;
+ }
 
-    //previous block is free but next block is allocated 
-    else if (!prevAlloc && nextAlloc) { 
-        remove_free_list(PREV_BLKP(bp));
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        PUT(FTRP(PREV_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);
-        add_free_list(bp);
-    }
+/////////// Heap checker /////////////////
 
-    // previous block is allocated but next block is free 
-    else if (prevAlloc && !nextAlloc) {
-        remove_free_list(NEXT_BLKP(bp));
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size,0));
-        add_free_list(bp);
-    }
-    // previous block is allocated and next block is allocated
-    else {  
-        add_free_list(bp);
-    }
-    //mm_check();
-    return bp;
+#ifdef MM_CHECK
+/* Heap blocks and list entries checked by each slice */
+#ifndef CHECK_SLICE
+ #define CHECK_SLICE 4
+#endif
+
+/* Operations between two runs of the full mm_check, a multiple of CHECK_EVERY */
+#ifndef CHECK_FULL
+ #define CHECK_FULL (1 << 16)
+#endif
+
+/* First block of the current arena, behind the prologue */
+ #define FIRST_BLKP (arena->index + (INDEX_WORDS + 2)*WSIZE)
+
+ static int check_block(char *bp);
+ static int check_entry(char *bp, int fl, int sl);
+ static int check_lists(int n);
+ static int check_tree(char *node, char *lo, char *hi, int *count);
+
+/*
+ * Report what is wrong with the heap at bp. Returns 1, the number of errors.
+ */
+ static int check_error(const char *what, void *bp)
+ {
+    fprintf(stderr, "mm_check: %s at %p\n", what, bp);
+    return 1;
  }
 
 /*
- * Reallocate a block of memory to a new size
- * if ptr is null, behave as mm_maloc
- * if size == 0, behave as free
- *    
+ * Check for consistency between the heap and free lists of the current 
+ * arena, all of it: every block of the heap, every entry of every list and
+ * the whole tree, and that numFree counts the free blocks. In MM_THREADS
+ * builds only the arena's first segment is walked, and numFree is checked
+ * against the lists and the tree alone.
+ *
+ * Return 1 if the heap is consistent, 0 otherwise.
  */
-void *mm_realloc(void *ptr, size_t size)
+static int mm_check(void)
 {
-    void *oldptr = ptr;
-    
-    size_t prevAlloc = GET_ALLOC(FTRP(PREV_BLKP(oldptr)));
-    size_t nextAlloc = GET_ALLOC(HDRP(NEXT_BLKP(oldptr)));
-    
-    size_t oldSize = GET_SIZE(HDRP(oldptr));
+    int error = 0;
+    int count, fl, sl;
+    unsigned long heapFree = 0, listFree = 0;
+    char *bp;
 
-    int change;
-    
-    //is new size is larger?
-    if(oldSize  < size + DSIZE){ 
-        change = 1;
+    // walk the heap
+    for (bp = FIRST_BLKP; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)){
+        if (check_block(bp)){
+            return 0;
+        }
+        heapFree += !GET_ALLOC(HDRP(bp));
     }
-    else{
-        change = 0;
+
+    // walk the lists, no further than numFree blocks in case of a cycle
+    for (fl = 0; fl < FL_INDEX_COUNT; fl++){
+        for (sl = 0; sl < SL_INDEX_COUNT; sl++){
+            bp = (char *)GET(LIST_HEAD(fl, sl));
+            for (; (word_t)bp != 0 && listFree <= (unsigned long)arena->numFree; bp = (char *)GET(bp + WSIZE)){
+                if (check_entry(bp, fl, sl)){
+                    return 0;
+                }
+                listFree++;
+            }
+        }
     }
 
-    void *newptr;
-    // if size is 0, just call mm_free
-    if (size == 0){
-        mm_free(ptr);
-        newptr = 0;
-        return NULL;
+    count = 0;
+    error += check_tree((char *)GET(TREE_ROOT), NULL, NULL, &count);
+    if (listFree + count != (unsigned long)arena->numFree){
+        error += check_error("numFree does not count the lists and the tree", arena->index);
     }
-    
-    //if pointer is NULL, just call mm_malloc
-    if (oldptr == NULL){        
-        return mm_malloc(size);
+#ifndef MM_THREADS
+    if (heapFree != (unsigned long)arena->numFree){
+        error += check_error("numFree does not count the free blocks of the heap", arena->index);
     }
+#endif
+    return error == 0;
+}
 
-    // ptr is decreasing in size and there is enough leaft over space to make a free block
-    if(change == 0 && (oldSize - size - DSIZE) > (2*DSIZE)){
-        // adjust block size       
-        if (size <= DSIZE){
-            size = 2*DSIZE;
-        }
-        else{
-            size =  DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE); // align size
+/*
+ * Check the next CHECK_SLICE blocks of the heap and entries of the lists,
+ * and one path down the tree, of the current arena, going on from where 
+ * the last check stopped. Every CHECK_FULL operations run mm_check 
+ * instead. Abort if the heap is broken.
+ */
+ static void check_slice(void)
+ {
+    int error = 0;
+    int i;
+    char *bp, *node, *lo = NULL, *hi = NULL;
+    unsigned long path;
+
+    if (arena->index == NULL){
+        return;
+    }
+    if (arena->checkOps % CHECK_FULL == 0){
+        if (!mm_check()){
+            abort();
         }
+        return;
+    }
 
-        // the adjusted size still has enough space to make a free block
-        if((oldSize - size) > (2*DSIZE)){
-            //reset header and footer
-            PUT(HDRP(oldptr), PACK(size, 1)); 
-            PUT(FTRP(oldptr), PACK(size, 1)); 
-         
+    // the heap, starting over at the epilogue
+    bp = arena->checkBlock != NULL ? arena->checkBlock : FIRST_BLKP;
+    for (i = 0; i < CHECK_SLICE && GET_SIZE(HDRP(bp)) > 0 && error == 0; i++){
+        error += check_block(bp);
+        bp = NEXT_BLKP(bp);
+    }
+    arena->checkBlock = (GET_SIZE(HDRP(bp)) > 0) ? bp : NULL;
 
-            newptr = oldptr;
-            oldptr =  (NEXT_BLKP(newptr)); 
-            
-            //set header and footer for the empty block
-            PUT(HDRP(oldptr), PACK(oldSize - size, 0));
-            PUT(FTRP(oldptr), PACK(oldSize - size, 0));
-          
-            coalesce(oldptr);
-        
-            return newptr;
-        }
+    if (error == 0){
+        error += check_lists(CHECK_SLICE);
     }
 
-    size_t tempSize;
-    size_t copySize;
-    void *temp;
-    
-    // ptr is decreasing in size but there isnt enough after to make a free block
-    if(change == 0) {
-        return ptr;
+    // a path down the tree picked by the operation count, checking that 
+    // the nodes keep their order and balance
+    path = arena->checkOps;
+    for (node = (char *)GET(TREE_ROOT); (word_t)node != 0 && error == 0; path >>= 1){
+        if (!IN_HEAP(node) || GET_ALLOC(HDRP(node)) || GET_SIZE(HDRP(node)) < LARGE_BLOCK_SIZE){
+            error += check_error("tree node is not a large free block", node);
+            break;
+        }
+        int left = tree_height(GET_LEFT(node));
+        int right = tree_height(GET_RIGHT(node));
+        if ((lo != NULL && !TREE_LESS(lo, node)) || (hi != NULL && !TREE_LESS(node, hi))){
+            error += check_error("tree out of order", node);
+        }
+        if (GET(HEIGHT(node)) != (word_t)MAX(left, right) + 1 || left - right > 1 || right - left > 1){
+            error += check_error("tree height or balance is wrong", node);
+        }
+        if (path & 1){
+            lo = node;
+            node = GET_RIGHT(node);
+        }
+        else{
+            hi = node;
+            node = GET_LEFT(node);
+        }
     }
-    
-    // ptr is increasing in size
-    else {
 
-        int tempPrev = GET_SIZE(HDRP(PREV_BLKP(oldptr)));
-        int tempNext = GET_SIZE(HDRP(NEXT_BLKP(oldptr)));
+    if (error){
+        abort();
+    }
+ }
 
-        // next and prev are unallocated and will create a large enough block 
-        if (nextAlloc == 0 && prevAlloc == 0 && (tempPrev + tempNext + oldSize) >= (size + DSIZE)){
-            newptr = PREV_BLKP(oldptr);
-            temp = NEXT_BLKP(oldptr);
-            tempSize = GET_SIZE(FTRP(newptr)) + GET_SIZE(FTRP(temp));
-            //remove from free list since they will combine into 1
-            remove_free_list(PREV_BLKP(oldptr));
-            remove_free_list(NEXT_BLKP(oldptr));
-                           
-            // adjust size 
-            if (size <= DSIZE){
-                size = 2*DSIZE;
-            }
-            else{
-                size =  DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE); 
-            }
+/*
+ * The bytes from bp to bp+size are about to become other blocks. If the 
+ * checker would go on from inside them it starts at bp instead.
+ */
+ static void check_carve(char *bp, size_t size)
+ {
+    if (arena->checkBlock > bp && arena->checkBlock < bp + size){
+        arena->checkBlock = bp;
+    }
+ }
 
-            // if not big enough for new free block
-            if((tempSize + oldSize) < (size + 2*DSIZE)){
-                size = tempSize + oldSize;
-            }
-                         
-            PUT(HDRP(newptr), PACK(size, 1));
-            copySize = GET_SIZE(HDRP(oldptr));
-            memcpy(newptr, oldptr, copySize);
-            PUT(FTRP(newptr), PACK(size, 1));
-            //new free block 
-            if((tempSize + oldSize) >= (size + 2*DSIZE)){ 
-                temp = NEXT_BLKP(newptr); 
-                //set new header and footer for free block
-                PUT(HDRP(temp), PACK(tempSize + oldSize - size, 0));
-                PUT(FTRP(temp), PACK(tempSize + oldSize - size, 0));
-                add_free_list(temp);
-            }
-            return newptr;                                       
-        }   
+/*
+ * Check a heap block of the current arena: its alignment and size, the 
+ * previous allocated bit of the next block, and for a free block its 
+ * footer, that it was coalesced and that it is on its list or in the tree.
+ *
+ * Return the number of errors. The walk cannot go on if there are any.
+ */
+ static int check_block(char *bp)
+ {
+    size_t size = GET_SIZE(HDRP(bp));
+    char *next = bp + size;
+    int error = 0;
+    int fl, sl;
 
-        // prev is unallocated and will create a large enough block when combined
-        else if(prevAlloc == 0 && ((tempPrev + oldSize) >= (size + DSIZE))){
-            newptr = PREV_BLKP(oldptr);
-            tempSize = GET_SIZE(FTRP(newptr));
-            remove_free_list(PREV_BLKP(oldptr));
-            //adjust size
-            if (size <= DSIZE){
-                size = 2*DSIZE;
-            }
-            else{
-                size =  DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
-            }
+    if ((word_t)bp % ALIGNMENT){
+        error += check_error("misaligned block", bp);
+    }
+    if (size % DSIZE || size < DSIZE || !IN_HEAP(bp) || next > arena->top){
+        return error + check_error("bad block size", bp);
+    }
+    if (!GET_PREV_ALLOC(HDRP(next)) != !GET_ALLOC(HDRP(bp))){
+        error += check_error("previous allocated bit of the next block is wrong", next);
+    }
+    if (GET_ALLOC(HDRP(bp))){
+        return error;
+    }
 
-            if((tempSize + oldSize) < (size + 2*DSIZE)){
-                size = tempSize + oldSize;
-            }
-            //set new header and footer            
-            PUT(HDRP(newptr), PACK(size, 1));         
-            copySize = GET_SIZE(HDRP(oldptr));
-            memcpy(newptr, oldptr, copySize);        
-            PUT(FTRP(newptr), PACK(size, 1)); 
-                     
-            //new free block                
-            if((tempSize + oldSize) >= (size + 2*DSIZE)){
-                                        
-                temp = NEXT_BLKP(newptr);
-                //set new header and footer for free block      
-                PUT(HDRP(temp), PACK(tempSize + oldSize - size, 0));
-                PUT(FTRP(temp), PACK(tempSize + oldSize - size, 0));
-                            
-                add_free_list(temp);
-            }
-            return newptr;            
-        }             
-                
-        // next is unallocated and will create a large enough block
-        else if(nextAlloc == 0 && (tempNext + oldSize) >= (size + DSIZE)){
-            temp = NEXT_BLKP(oldptr);
-            tempSize = GET_SIZE(FTRP(temp));
-            remove_free_list(NEXT_BLKP(ptr));
-            //adjust size
-            if (size <= DSIZE){
-                size = 2*DSIZE;
-            }
-            else{
-                size =  DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
-            }
+    if (GET_SIZE(FTRP(bp)) != size || GET_ALLOC(FTRP(bp))){
+        error += check_error("footer does not match the header", bp);
+    }
+    if (!GET_ALLOC(HDRP(next))){
+        error += check_error("free block is not coalesced with the next one", bp);
+    }
 
-            if((tempSize + oldSize) < (size + 2*DSIZE)){
-                size = tempSize + oldSize;
-            }
-            //set header and footer            
-            PUT(HDRP(oldptr), PACK(size, 1));
-            PUT(FTRP(oldptr), PACK(size, 1)); 
-                   
-            //new free block                
-            if((tempSize + oldSize) >= (size + 2*DSIZE)){ 
-                newptr = NEXT_BLKP(oldptr);
-                //set new header and footer for free block                       
-                PUT(HDRP(newptr), PACK(tempSize + oldSize - size, 0));
-                PUT(FTRP(newptr), PACK(tempSize + oldSize - size, 0));
-                            
-                add_free_list(newptr);
-            }
-            return oldptr;                            
+    // a free block is on the list its size maps to, or in the tree
+    if (size >= LARGE_BLOCK_SIZE){
+        char *node = (char *)GET(TREE_ROOT);
+        while ((word_t)node != 0 && node != bp){
+            node = TREE_LESS(bp, node) ? GET_LEFT(node) : GET_RIGHT(node);
         }
-
-        //prev and next are already allocated
-        else{         
-            newptr = mm_malloc(size);
-            copySize = GET_SIZE(HDRP(oldptr));
-            if (size < copySize){
-                copySize = size;
-            }
-                
-            memcpy(newptr, oldptr, copySize);   
-            mm_free(oldptr);
+        if (node != bp){
+            error += check_error("free block is not in the tree", bp);
         }
-        return newptr;
+        return error;
     }
-}
+    mapping_insert(size, &fl, &sl);
+    char *prev = (char *)GET(bp);
+    if (!(GET(SL_BITMAP(fl)) & (1U << sl)) ||
+        (char *)GET((word_t)prev == 0 ? LIST_HEAD(fl, sl) : prev + WSIZE) != bp){
+        error += check_error("free block is not on its list", bp);
+    }
+    return error;
+ }
 
 /*
- * Check for consistency between the heap and free list.
- * Make sure the pointers are valid.
- * Check if there are contiguous free blocks.
+ * Check an entry of list sl of class fl: it must be a free heap block of a
+ * size that maps to that list, linked both ways to the next entry.
+ *
+ * Return the number of errors.
  */
+ static int check_entry(char *bp, int fl, int sl)
+ {
+    int efl, esl;
+    char *next;
 
-/*
+    if (!IN_HEAP(bp) || (word_t)bp % ALIGNMENT){
+        return check_error("list entry outside the heap", bp);
+    }
+    if (GET_ALLOC(HDRP(bp))){
+        return check_error("allocated block on a free list", bp);
+    }
+    mapping_insert(GET_SIZE(HDRP(bp)), &efl, &esl);
+    if (efl != fl || esl != sl){
+        return check_error("block on the wrong list for its size", bp);
+    }
+    next = (char *)GET(bp + WSIZE);
+    if ((word_t)next != 0 && (char *)GET(next) != bp){
+        return check_error("list links do not match", bp);
+    }
+    return 0;
+ }
 
-static int mm_check(void){
+/*
+ * Check the next n entries of the lists, going through the lists one after
+ * the other. At the head of a list the bitmaps must say whether it is 
+ * empty.
+ *
+ * Return the number of errors.
+ */
+ static int check_lists(int n)
+ {
     int error = 0;
-    size_t* topHeap =  mem_heap_lo();        
-    size_t* bottomHeap =  mem_heap_hi();        
-    void* tempPtr;
-
-    //while there is a next pointer, keep looping
-    for(tempPtr = topHeap; GET_SIZE(HDRP(tempPtr)) > 0; tempPtr = NEXT_BLKP(tempPtr)) {
-                
-        if (GET_ALLOC(HDRP(tempPtr)) == 0 && GET_ALLOC(HDRP(NEXT_BLKP(tempPtr)))==0){
-            error += 1;
-            //printf("Error: blocks %p and %p are contiguous free block\n", tempPtr, NEXT_BLKP(tempPtr));
+    int fl, sl;
+    char *head;
+
+    while (n-- > 0 && error == 0){
+        fl = arena->checkList / SL_INDEX_COUNT;
+        sl = arena->checkList % SL_INDEX_COUNT;
+
+        if (arena->checkEntry == NULL){
+            head = (char *)GET(LIST_HEAD(fl, sl));
+            if (!(GET(SL_BITMAP(fl)) & (1U << sl)) != ((word_t)head == 0) ||
+                !(GET(FL_BITMAP) & (1U << fl)) != (GET(SL_BITMAP(fl)) == 0)){
+                error += check_error("list bitmaps do not match the lists", LIST_HEAD(fl, sl));
+            }
+            if ((word_t)head != 0 && GET(head) != 0){
+                error += check_error("list head has a previous entry", head);
+            }
+            arena->checkEntry = head;
         }
-
-        if ((int)tempPtr > (int)bottomHeap || (int)tempPtr < (int)topHeap){        
-            error += 1;
-            //printf("Error: pointer %p out of heap bounds\n", tempPtr);
+        else{
+            error += check_entry(arena->checkEntry, fl, sl);
+            if (error == 0){
+                arena->checkEntry = (char *)GET(arena->checkEntry + WSIZE);
+            }
         }
 
-        if ((size_t)tempPtr%8){
-            error += 1;
-            //printf("Error: %p misaligned our headers and payload\n", tempPtr);
+        // on to the next list
+        if ((word_t)arena->checkEntry == 0){
+            arena->checkEntry = NULL;
+            arena->checkList = (arena->checkList + 1) % (FL_INDEX_COUNT * SL_INDEX_COUNT);
         }
     }
-
-    if( error == 0){
-        return 1;
-    }
-    return 0;
+    return error;
  }
+
+/*
+ * Check the subtree at node: every node is a free block of a large size,
+ * between lo and hi in tree order, with the right height and balanced. 
+ * Adds the number of nodes to *count.
+ *
+ * Return the number of errors.
  */
+ static int check_tree(char *node, char *lo, char *hi, int *count)
+ {
+    int error, left, right;
 
+    if ((word_t)node == 0){
+        return 0;
+    }
+    if (!IN_HEAP(node) || GET_ALLOC(HDRP(node)) || GET_SIZE(HDRP(node)) < LARGE_BLOCK_SIZE){
+        return check_error("tree node is not a large free block", node);
+    }
+    (*count)++;
+    error = check_tree(GET_LEFT(node), lo, node, count) +
+            check_tree(GET_RIGHT(node), node, hi, count);
+    if ((lo != NULL && !TREE_LESS(lo, node)) || (hi != NULL && !TREE_LESS(node, hi))){
+        error += check_error("tree out of order", node);
+    }
+    left = tree_height(GET_LEFT(node));
+    right = tree_height(GET_RIGHT(node));
+    if (GET(HEIGHT(node)) != (word_t)MAX(left, right) + 1 || left - right > 1 || right - left > 1){
+        error += check_error("tree height or balance is wrong", node);
+    }
+    return error;
+ }
+#endif
@@ -2,8 +2,94 @@
 
 extern int mm_init (void);
 extern void *mm_malloc (size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
 extern void mm_free (void *ptr);
+extern void mm_free_sized(void *ptr, size_t size);
 extern void *mm_realloc(void *ptr, size_t size);
+extern int mm_malloc_batch(size_t size, int n, void **out);
+extern void mm_free_batch(void **ptrs, int n);
+
+/* 
+ * Placement policies of the free block search. The environment variable
+ * MM_POLICY, read by mm_init, picks one by name: good (the default), 
+ * first, next or best.
+ */
+enum { MM_FIT_GOOD, MM_FIT_FIRST, MM_FIT_NEXT, MM_FIT_BEST };
+
+/* Free block searches since mm_init */
+typedef struct {
+    const char *policy;     /* name of the placement policy */
+    unsigned long searches; /* free block searches */
+    unsigned long examined; /* free blocks they looked at */
+    unsigned long misses;   /* searches that found no block */
+    double slack;           /* bytes the blocks found were larger than asked for */
+} mm_fit_t;
+
+extern void mm_fit_stats(mm_fit_t *stats);
+
+/* Most free lists mm_stats reports on, the large block tree included */
+#define MM_STATS_BINS 256
+
+/* 
+ * The heap right now and operations since mm_init. Blocks handed out or 
+ * taken back by the thread cache of an MM_THREADS build, and reallocs 
+ * that fit the slack a growing block already has, are not counted.
+ */
+typedef struct {
+    size_t heap;            /* bytes in the heap */
+    size_t mapped;          /* bytes in blocks with a mapping of their own */
+    size_t live;            /* heap and mapped bytes not free or cached */
+    size_t free;            /* bytes in free blocks on the lists and in the tree */
+    size_t cached;          /* bytes in freed blocks waiting in the fast bins */
+    size_t largest;         /* largest free block */
+    unsigned long numFree;  /* free blocks on the lists and in the tree */
+    int nbins;              /* lists in bins, the last one is the tree */
+    struct {
+        size_t size;          /* least block size on the list */
+        unsigned long count;  /* free blocks on it */
+        size_t bytes;         /* bytes in them */
+    } bins[MM_STATS_BINS];
+    unsigned long mallocs;  /* blocks allocated, by any of the calls */
+    unsigned long frees;    /* blocks freed */
+    unsigned long reallocs; /* reallocs of allocated blocks, moved or not */
+    unsigned long splits;   /* free blocks split into a block and a smaller free block */
+    unsigned long coalesces;/* free blocks merged with a free neighbor */
+    unsigned long extends;  /* times the heap grew */
+} mm_stats_t;
+
+extern void mm_stats(mm_stats_t *stats);
+
+/* 
+ * Read or set allocator settings and read statistics by name, in the way
+ * of jemalloc's mallctl. The value is read into oldp, *oldlenp bytes, and
+ * set from newp, newlen bytes; either may be NULL. Returns 0, or ENOENT, 
+ * EPERM or EINVAL. The names are:
+ *
+ *   opt.chunk_size        size_t  least bytes an arena starts with and grows by
+ *   opt.grow_max          size_t  most bytes the heap grows by beyond a request
+ *   opt.mmap_threshold    size_t  requests this large get a mapping of their own
+ *   opt.trim_threshold    size_t  a free block this large at the heap end is trimmed
+ *   opt.search_cap        int     blocks a good fit looks at on a list, -1 for all
+ *   opt.policy            const char *  placement policy, as for MM_POLICY
+ *   arenas.narenas        int     number of arenas, read only
+ *   stats.<field>         read only, the mm_stats field heap, mapped, live, 
+ *                         free_bytes, cached, largest (size_t), nbins (int),
+ *                         free_blocks, mallocs, frees, reallocs, splits, 
+ *                         coalesces or extends (unsigned long)
+ *   stats.bins.<i>.size, .count, .free_bytes   bin i of mm_stats
+ *   arena.<i>.purge, arena.all.purge   coalesce the fast bins and give the
+ *                         free end of the heap back to the system
+ *   thread.tcache.flush   empty the calling thread's cache
+ *
+ * The opt sizes must be multiples of the block alignment, and chunk_size
+ * and grow_max at least two alignments. Writes to opt names lock every
+ * arena, so they are safe while threads run; mmap_threshold is read 
+ * before a request locks its arena, so a request that is already under 
+ * way may still see the old one.
+ */
+extern int mm_ctl(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen);
 
 
 /* 
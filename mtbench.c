@@ -0,0 +1,178 @@
+/*
+ * mtbench.c - Thread scaling benchmark for the mm.c arenas
+ *
+ * Runs the same malloc/free workload with 1, 2, 4, ... up to 64 threads 
+ * and prints the throughput for each thread count. Each thread keeps a 
+ * table of live blocks and either frees or allocates a random entry on 
+ * every step. With -r, that percentage of the frees trade the block through
+ * a shared exchange table first, so it is freed by a different thread than 
+ * the one that allocated it.
+ *
+ * Build with "make mtbench", which compiles mm.c with MM_THREADS.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* Misc */
+#define MAXTHREADS  64   /* most threads to scale up to */
+#define LIVE       256   /* live blocks kept by each thread */
+#define EXCHANGE  1024   /* entries in the shared exchange table */
+
+/* Parameters of one run */
+static int num_ops = 200000;     /* malloc/free steps per thread */
+static int remote_pct = 0;       /* percentage of frees done by another thread */
+static void *exchange[EXCHANGE]; /* blocks on their way to another thread */
+
+/* Function prototypes */
+static void *worker(void *arg);
+static double run(int nthreads);
+static void usage(void);
+
+/*
+ * main - Run the workload for each thread count and print a table
+ */
+int main(int argc, char **argv)
+{
+    int c, n;
+    int max_threads = MAXTHREADS;
+    int use_mmap = 0;
+    double secs, base = 0;
+
+    while ((c = getopt(argc, argv, "ho:r:t:n")) != EOF) {
+        switch (c) {
+        case 'o': /* Steps per thread */
+            num_ops = atoi(optarg);
+            break;
+        case 'r': /* Percentage of remote frees */
+            remote_pct = atoi(optarg);
+            break;
+        case 't': /* Most threads */
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > MAXTHREADS)
+                max_threads = MAXTHREADS;
+            break;
+        case 'n': /* Have memlib use mmap() */
+            use_mmap = 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    mem_init(use_mmap);
+
+    printf("%7s%12s%10s%10s%9s\n", "threads", "ops", "secs", "Kops", "speedup");
+    for (n = 1; n <= max_threads; n *= 2) {
+        secs = run(n);
+        if (n == 1)
+            base = num_ops / secs;
+        printf("%7d%12.0f%10.4f%10.0f%9.2f\n", n, (double)n * num_ops, secs,
+               (n * num_ops / 1e3) / secs, (n * num_ops / secs) / base);
+    }
+
+    mem_deinit();
+    exit(0);
+}
+
+/*
+ * run - Reset the heap, run the workload on nthreads threads and 
+ *       return the wall clock time it took
+ */
+static double run(int nthreads)
+{
+    pthread_t tid[MAXTHREADS];
+    struct timeval start, end;
+    long i;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mm_init failed\n");
+        exit(1);
+    }
+    memset(exchange, 0, sizeof(exchange));
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < nthreads; i++)
+        pthread_create(&tid[i], NULL, worker, (void *)(i + 1));
+    for (i = 0; i < nthreads; i++)
+        pthread_join(tid[i], NULL);
+    gettimeofday(&end, NULL);
+
+    /* blocks still in the exchange table go back too */
+    for (i = 0; i < EXCHANGE; i++)
+        mm_free(exchange[i]);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+}
+
+/*
+ * worker - One thread of the workload: mostly small blocks, some 
+ *          medium and a few larger ones
+ */
+static void *worker(void *arg)
+{
+    char *live[LIVE];
+    unsigned int seed = (unsigned int)(long)arg * 2654435761u;
+    int i, slot;
+    size_t size;
+    char *p;
+
+    memset(live, 0, sizeof(live));
+    for (i = 0; i < num_ops; i++) {
+        seed = seed * 1103515245 + 12345;
+        slot = (seed >> 8) % LIVE;
+
+        if (live[slot] != NULL) {
+            p = live[slot];
+            live[slot] = NULL;
+            /* trade the block for one some other thread put there */
+            if ((int)((seed >> 16) % 100) < remote_pct)
+                p = __sync_lock_test_and_set(&exchange[(seed >> 4) % EXCHANGE], p);
+            mm_free(p);
+        }
+        else {
+            seed = seed * 1103515245 + 12345;
+            if ((seed >> 16) % 100 < 70)
+                size = 8 + (seed >> 8) % 57;
+            else if ((seed >> 16) % 100 < 95)
+                size = 65 + (seed >> 8) % 448;
+            else
+                size = 513 + (seed >> 8) % 3584;
+            if ((p = mm_malloc(size)) == NULL) {
+                fprintf(stderr, "mm_malloc failed\n");
+                exit(1);
+            }
+            p[0] = p[size - 1] = (char)i;
+            live[slot] = p;
+        }
+    }
+
+    for (slot = 0; slot < LIVE; slot++)
+        mm_free(live[slot]);
+    return NULL;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mtbench [-hn] [-o <ops>] [-r <pct>] [-t <threads>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-n         Have memlib use mmap() for the heap.\n");
+    fprintf(stderr, "\t-o <ops>   Malloc/free steps per thread.\n");
+    fprintf(stderr, "\t-r <pct>   Percentage of frees done by another thread.\n");
+    fprintf(stderr, "\t-t <n>     Most threads to run (up to 64).\n");
+}